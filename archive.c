@@ -0,0 +1,665 @@
+/*
+ * Read-only access to NuFX (ShrinkIt) and Binary II archives.
+ *
+ * The record and thread layouts follow Apple II File Type Note $E0/8002 (NuFX), and
+ * Binary II follows File Type Note $E0/8000.  ShrinkIt's LZW is a variable width
+ * (9 to 12 bit) LZW over run length encoded 4K chunks: LZW/1 starts a new table for
+ * every chunk, while LZW/2 keeps it until a clear code or a chunk that was stored.
+ */
+
+#include "archive.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+#define NUFX_MASTER_HEADER_LEN 48
+#define NUFX_MIN_ATTRIB_COUNT  58
+#define NUFX_MAX_ATTRIB_COUNT  512
+#define NUFX_THREAD_HEADER_LEN 16
+#define NUFX_MAX_THREADS       64
+
+#define BINARY_II_HEADER_LEN   128
+#define BINARY_II_MAX_NAME     64
+
+#define MAX_PATH_LEN           256
+#define INPUT_LEN              512
+
+#define LZW_CHUNK_LEN          4096
+#define LZW_TABLE_SIZE         4096
+#define LZW_CLEAR_CODE         0x100
+#define LZW_FIRST_CODE         0x101
+
+/* Thread classes and kinds, and the formats their data may be stored in. */
+enum { MESSAGE_THREAD = 0, CONTROL_THREAD = 1, DATA_THREAD = 2, FILENAME_THREAD = 3 };
+enum { DATA_FORK = 0, DISK_IMAGE = 1, RESOURCE_FORK = 2 };
+enum { UNCOMPRESSED = 0, SQUEEZED = 1, LZW1 = 2, LZW2 = 3 };
+
+enum { NUFX_ARCHIVE, BINARY_II_ARCHIVE };
+
+#define PRODOS_T_DIR           0x0F
+#define PRODOS_T_LBR           0xE0
+#define PRODOS_AUX_T_SHRINKIT  0x8002
+
+struct archive {
+	FILE*         fp;
+	int           kind;
+};
+
+struct archive_stream {
+	FILE*         fp;
+	int           format;
+	long          remaining;     /* bytes of the thread not yet read from the archive */
+	long          left;          /* bytes of the member not yet returned             */
+	int           started;       /* the thread header of an LZW thread has been read */
+	int           rleDelimiter;
+	
+	unsigned char input[INPUT_LEN];
+	int           inputLen;
+	int           inputPos;
+	unsigned long bits;          /* bits read from the input but not yet used        */
+	int           bitCount;
+	
+	unsigned int  entry;         /* the next free code                               */
+	int           reset;         /* the next code starts a new table                 */
+	unsigned int  oldCode;
+	unsigned char finalChar;
+	unsigned int  prefix[LZW_TABLE_SIZE];
+	unsigned char suffix[LZW_TABLE_SIZE];
+	unsigned char stack[LZW_TABLE_SIZE];
+	
+	unsigned char packed[LZW_CHUNK_LEN];  /* a chunk before its runs are expanded */
+	unsigned char chunk[LZW_CHUNK_LEN];
+	int           chunkLen;
+	int           chunkPos;
+};
+
+/* NuFX marks its headers with "NuFile" and "NuFX", with alternate high bits set. */
+static const unsigned char nufxMasterId[6] = { 0x4E, 0xF5, 0x46, 0xE9, 0x6C, 0xE5 };
+static const unsigned char nufxRecordId[4] = { 0x4E, 0xF5, 0x46, 0xD8 };
+
+
+
+/* Private functions: */
+static unsigned int get16(const unsigned char* p) {
+	return p[0] | ((unsigned int) p[1] << 8);
+}
+
+static long get24(const unsigned char* p) {
+	return p[0] | ((long) p[1] << 8) | ((long) p[2] << 16);
+}
+
+static long get32(const unsigned char* p) {
+	return get24(p) | ((long) p[3] << 24);
+}
+
+static int hasExtension(const char* path, const char* ext) {
+	size_t pathLen = strlen(path);
+	size_t extLen = strlen(ext);
+	size_t i;
+	
+	if (pathLen <= extLen) {
+		return 0;
+	}
+	
+	path += pathLen - extLen;
+	
+	for (i = 0; i < extLen; i++) {
+		if (tolower((unsigned char) path[i]) != ext[i]) {
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+static int readAt(FILE* fp, long offset, unsigned char* buf, size_t len) {
+	if (fseek(fp, offset, SEEK_SET) != 0) {
+		return -1;
+	}
+	
+	return (fread(buf, 1, len, fp) == len) ? 0 : -1;
+}
+
+/* Copy a stored name into path, turning the archive's separator into '/'. */
+static void copyName(char* path, const unsigned char* name, long len, int separator) {
+	long i;
+	
+	if (len > MAX_PATH_LEN - 1) {
+		len = MAX_PATH_LEN - 1;
+	}
+	
+	for (i = 0; i < len; i++) {
+		path[i] = ((name[i] & 0x7F) == separator) ? '/' : (char) (name[i] & 0x7F);
+	}
+	
+	path[len] = '\0';
+}
+
+/* Walk the records of the NuFX archive that starts at offset. */
+static int walkNufx(archive* arc, long offset, archive_visitor visit, void* context) {
+	unsigned char* header;
+	unsigned char* threads = NULL;
+	char path[MAX_PATH_LEN];
+	long records, position, dataPosition;
+	int result = 0;
+	
+	if ((header = (unsigned char*) malloc(NUFX_MAX_ATTRIB_COUNT)) == NULL) {
+		return -1;
+	}
+	
+	if ((readAt(arc->fp, offset, header, NUFX_MASTER_HEADER_LEN) != 0) ||
+		(memcmp(header, nufxMasterId, sizeof(nufxMasterId)) != 0)) {
+		free(header);
+		return -1;
+	}
+	
+	records = get32(&header[8]);
+	position = offset + NUFX_MASTER_HEADER_LEN;
+	
+	for (; (result == 0) && (records > 0); records--) {
+		unsigned int attribCount, nameLength;
+		long threadCount, i;
+		int separator;
+		archive_entry entry;
+		
+		if ((readAt(arc->fp, position, header, 8) != 0) ||
+			(memcmp(header, nufxRecordId, sizeof(nufxRecordId)) != 0)) {
+			result = -1;
+			break;
+		}
+		
+		attribCount = get16(&header[6]);
+		
+		if ((attribCount < NUFX_MIN_ATTRIB_COUNT) || (attribCount > NUFX_MAX_ATTRIB_COUNT) ||
+			(readAt(arc->fp, position, header, attribCount) != 0)) {
+			result = -1;
+			break;
+		}
+		
+		threadCount = get32(&header[10]);
+		separator = header[16] & 0x7F;
+		entry.fileType = (int) (get32(&header[22]) & 0xFFFF);
+		entry.auxType = (unsigned long) get32(&header[26]);
+		nameLength = get16(&header[attribCount - 2]);
+		
+		if ((threadCount < 0) || (threadCount > NUFX_MAX_THREADS)) {
+			result = -1;
+			break;
+		}
+		
+		/* old archives keep the name in the record; newer ones use a filename thread */
+		path[0] = '\0';
+		
+		if (nameLength > 0) {
+			unsigned char* name;
+			
+			if (((name = (unsigned char*) malloc(nameLength)) == NULL) ||
+				(readAt(arc->fp, position + attribCount, name, nameLength) != 0)) {
+				free(name);
+				result = -1;
+				break;
+			}
+			
+			copyName(path, name, nameLength, separator);
+			free(name);
+		}
+		
+		position += attribCount + nameLength;
+		dataPosition = position + threadCount * NUFX_THREAD_HEADER_LEN;
+		
+		if (((threads = (unsigned char*) malloc((size_t) threadCount * NUFX_THREAD_HEADER_LEN + 1)) == NULL) ||
+			(readAt(arc->fp, position, threads, (size_t) threadCount * NUFX_THREAD_HEADER_LEN) != 0)) {
+			result = -1;
+			break;
+		}
+		
+		for (i = 0, position = dataPosition; i < threadCount; i++) {
+			const unsigned char* t = &threads[i * NUFX_THREAD_HEADER_LEN];
+			long eof = get32(&t[8]);
+			
+			if ((get16(&t[0]) == FILENAME_THREAD) && (eof > 0) && (eof < MAX_PATH_LEN) &&
+				(eof <= get32(&t[12]))) {
+				unsigned char name[MAX_PATH_LEN];
+				
+				if (readAt(arc->fp, position, name, (size_t) eof) == 0) {
+					copyName(path, name, eof, separator);
+				}
+			}
+			
+			position += get32(&t[12]);
+		}
+		
+		for (i = 0, position = dataPosition; (result == 0) && (i < threadCount); i++) {
+			const unsigned char* t = &threads[i * NUFX_THREAD_HEADER_LEN];
+			
+			if ((get16(&t[0]) == DATA_THREAD) &&
+				((get16(&t[4]) == DATA_FORK) || (get16(&t[4]) == DISK_IMAGE))) {
+				entry.isDiskImage = (get16(&t[4]) == DISK_IMAGE);
+				entry.format = get16(&t[2]);
+				entry.eof = get32(&t[8]);
+				entry.offset = position;
+				entry.length = get32(&t[12]);
+				
+				/* a disk image may not record its length, but says how many blocks it has */
+				if (entry.isDiskImage && (entry.eof == 0)) {
+					entry.eof = (long) entry.auxType * get16(&header[30]);
+				}
+				
+				result = visit(context, (path[0] != '\0') ? path : "(unnamed)", &entry);
+			}
+			
+			position += get32(&t[12]);
+		}
+		
+		free(threads);
+		threads = NULL;
+	}
+	
+	free(threads);
+	free(header);
+	return result;
+}
+
+/* Walk the files of a Binary II archive, each a header followed by its data padded
+   to a multiple of 128 bytes. */
+static int walkBinaryII(archive* arc, archive_visitor visit, void* context) {
+	unsigned char header[BINARY_II_HEADER_LEN];
+	char path[MAX_PATH_LEN];
+	long position = 0;
+	int result = 0;
+	
+	while (result == 0) {
+		archive_entry entry;
+		size_t n;
+		
+		if (fseek(arc->fp, position, SEEK_SET) != 0) {
+			return -1;
+		}
+		
+		if ((n = fread(header, 1, BINARY_II_HEADER_LEN, arc->fp)) == 0) {
+			break;
+		}
+		
+		if ((n != BINARY_II_HEADER_LEN) || (header[0] != 0x0A) || (header[1] != 0x47) ||
+			(header[2] != 0x4C) || (header[18] != 0x02)) {
+			return -1;
+		}
+		
+		entry.fileType = header[4];
+		entry.auxType = get16(&header[5]);
+		entry.isDiskImage = 0;
+		entry.eof = get24(&header[20]) | ((long) header[116] << 24);
+		entry.format = UNCOMPRESSED;
+		entry.offset = position + BINARY_II_HEADER_LEN;
+		entry.length = entry.eof;
+		
+		if (entry.eof < 0) {
+			return -1;
+		}
+		
+		copyName(path, &header[24], (header[23] < BINARY_II_MAX_NAME) ? header[23] : BINARY_II_MAX_NAME, '/');
+		position = entry.offset + ((entry.eof + BINARY_II_HEADER_LEN - 1) & ~(long) (BINARY_II_HEADER_LEN - 1));
+		
+		/* directories, phantom files and squeezed files have nothing to search; a
+		   ShrinkIt archive (as in a .bxy) is searched in its place. */
+		if ((entry.fileType == PRODOS_T_DIR) || (header[124] != 0) || ((header[125] & 0x80) != 0)) {
+			continue;
+		} else if ((entry.fileType == PRODOS_T_LBR) && (entry.auxType == PRODOS_AUX_T_SHRINKIT)) {
+			result = walkNufx(arc, entry.offset, visit, context);
+		} else {
+			result = visit(context, path, &entry);
+		}
+	}
+	
+	return result;
+}
+
+/* Return the next byte of the thread, or -1 at its end. */
+static int nextByte(archive_stream* stream) {
+	if (stream->inputPos == stream->inputLen) {
+		size_t want = (stream->remaining < INPUT_LEN) ? (size_t) stream->remaining : INPUT_LEN;
+		
+		if ((want == 0) || ((want = fread(stream->input, 1, want, stream->fp)) == 0)) {
+			return -1;
+		}
+		
+		stream->remaining -= want;
+		stream->inputLen = (int) want;
+		stream->inputPos = 0;
+	}
+	
+	return stream->input[stream->inputPos++];
+}
+
+/* Return the next code of width bits, which are packed least significant bit first. */
+static int nextCode(archive_stream* stream, int width) {
+	unsigned int code;
+	
+	while (stream->bitCount < width) {
+		int c = nextByte(stream);
+		
+		if (c < 0) {
+			return -1;
+		}
+		
+		stream->bits |= (unsigned long) c << stream->bitCount;
+		stream->bitCount += 8;
+	}
+	
+	code = (unsigned int) (stream->bits & ((1UL << width) - 1));
+	stream->bits >>= width;
+	stream->bitCount -= width;
+	
+	return (int) code;
+}
+
+/* Undo the LZW of a chunk into packed, until it holds length bytes. */
+static int expandLzw(archive_stream* stream, int length) {
+	int done = 0;
+	
+	while (done < length) {
+		unsigned int next = stream->entry + 1;
+		int width = (next < 0x200) ? 9 : (next < 0x400) ? 10 : (next < 0x800) ? 11 : 12;
+		int code, inCode, depth = 0;
+		
+		/* ShrinkIt widens its codes one entry before the table needs it */
+		if ((code = nextCode(stream, width)) < 0) {
+			return -1;
+		}
+		
+		if (stream->reset) {
+			if (code > 0xFF) {
+				return -1;
+			}
+			
+			stream->oldCode = code;
+			stream->finalChar = (unsigned char) code;
+			stream->packed[done++] = (unsigned char) code;
+			stream->reset = 0;
+			continue;
+		}
+		
+		if (code == LZW_CLEAR_CODE) {
+			if (stream->format != LZW2) {
+				return -1;
+			}
+			
+			stream->entry = LZW_FIRST_CODE;
+			stream->reset = 1;
+			continue;
+		}
+		
+		inCode = code;
+		
+		/* a code that is about to be defined is the previous string plus its own first
+		   character */
+		if ((unsigned int) code >= stream->entry) {
+			if ((unsigned int) code > stream->entry) {
+				return -1;
+			}
+			
+			stream->stack[depth++] = stream->finalChar;
+			code = stream->oldCode;
+		}
+		
+		while (code > 0xFF) {
+			if (depth >= LZW_TABLE_SIZE - 1) {
+				return -1;
+			}
+			
+			stream->stack[depth++] = stream->suffix[code];
+			code = stream->prefix[code];
+		}
+		
+		stream->finalChar = (unsigned char) code;
+		stream->stack[depth++] = (unsigned char) code;
+		
+		while ((depth > 0) && (done < length)) {
+			stream->packed[done++] = stream->stack[--depth];
+		}
+		
+		if (stream->entry < LZW_TABLE_SIZE) {
+			stream->prefix[stream->entry] = stream->oldCode;
+			stream->suffix[stream->entry] = stream->finalChar;
+			stream->entry++;
+		}
+		
+		stream->oldCode = inCode;
+	}
+	
+	/* each chunk's codes start on a byte boundary */
+	stream->bits = 0;
+	stream->bitCount = 0;
+	
+	return 0;
+}
+
+/* Read the next 4K chunk of an LZW thread into stream->chunk. */
+static int nextChunk(archive_stream* stream) {
+	unsigned int rleLength;
+	int lzw, i, c, count;
+	
+	if (!stream->started) {
+		/* LZW/1 starts with a CRC of the whole member; both then give the volume
+		   number and the byte that introduces a run. */
+		if ((stream->format == LZW1) && ((nextByte(stream) < 0) || (nextByte(stream) < 0))) {
+			return -1;
+		}
+		
+		if ((nextByte(stream) < 0) || ((stream->rleDelimiter = nextByte(stream)) < 0)) {
+			return -1;
+		}
+		
+		stream->started = 1;
+		stream->entry = LZW_FIRST_CODE;
+		stream->reset = 1;
+	}
+	
+	if (((c = nextByte(stream)) < 0) || ((i = nextByte(stream)) < 0)) {
+		return -1;
+	}
+	
+	rleLength = c | ((unsigned int) i << 8);
+	
+	if (stream->format == LZW1) {
+		if ((lzw = nextByte(stream)) < 0) {
+			return -1;
+		}
+		
+		stream->entry = LZW_FIRST_CODE;
+		stream->reset = 1;
+	} else {
+		lzw = (rleLength & 0x8000) != 0;
+		rleLength &= 0x1FFF;
+		
+		/* the length of the compressed chunk is not needed to read it */
+		if (lzw && ((nextByte(stream) < 0) || (nextByte(stream) < 0))) {
+			return -1;
+		}
+		
+		if (!lzw) {
+			stream->entry = LZW_FIRST_CODE;
+			stream->reset = 1;
+		}
+	}
+	
+	if ((rleLength == 0) || (rleLength > LZW_CHUNK_LEN)) {
+		return -1;
+	}
+	
+	if (lzw) {
+		if (expandLzw(stream, (int) rleLength) != 0) {
+			return -1;
+		}
+	} else {
+		for (i = 0; (unsigned int) i < rleLength; i++) {
+			if ((c = nextByte(stream)) < 0) {
+				return -1;
+			}
+			
+			stream->packed[i] = (unsigned char) c;
+		}
+	}
+	
+	/* a chunk that runs didn't shrink is left as it was */
+	if (rleLength == LZW_CHUNK_LEN) {
+		memcpy(stream->chunk, stream->packed, LZW_CHUNK_LEN);
+		stream->chunkLen = LZW_CHUNK_LEN;
+	} else {
+		stream->chunkLen = 0;
+		
+		for (i = 0; ((unsigned int) i < rleLength) && (stream->chunkLen < LZW_CHUNK_LEN); i++) {
+			c = stream->packed[i];
+			
+			if ((c == stream->rleDelimiter) && ((unsigned int) i + 2 < rleLength)) {
+				c = stream->packed[++i];
+				count = stream->packed[++i] + 1;
+				
+				if (count > LZW_CHUNK_LEN - stream->chunkLen) {
+					count = LZW_CHUNK_LEN - stream->chunkLen;
+				}
+				
+				memset(&stream->chunk[stream->chunkLen], c, count);
+				stream->chunkLen += count;
+			} else {
+				stream->chunk[stream->chunkLen++] = (unsigned char) c;
+			}
+		}
+	}
+	
+	stream->chunkPos = 0;
+	return 0;
+}
+
+
+
+/* Public functions: */
+int archive_is_archive_name(const char* path) {
+	return hasExtension(path, ".shk") || hasExtension(path, ".sdk") || hasExtension(path, ".bxy") ||
+		hasExtension(path, ".bny") || hasExtension(path, ".bqy");
+}
+
+archive* archive_open(const char* path) {
+	archive* arc;
+	unsigned char buf[BINARY_II_HEADER_LEN];
+	size_t n;
+	
+	if ((arc = (archive*) malloc(sizeof(archive))) == NULL) {
+		return NULL;
+	}
+	
+	if ((arc->fp = fopen(path, "rb")) == NULL) {
+		free(arc);
+		return NULL;
+	}
+	
+	n = fread(buf, 1, BINARY_II_HEADER_LEN, arc->fp);
+	
+	if ((n >= NUFX_MASTER_HEADER_LEN) && (memcmp(buf, nufxMasterId, sizeof(nufxMasterId)) == 0)) {
+		arc->kind = NUFX_ARCHIVE;
+	} else if ((n == BINARY_II_HEADER_LEN) && (buf[0] == 0x0A) && (buf[1] == 0x47) &&
+			   (buf[2] == 0x4C) && (buf[18] == 0x02)) {
+		arc->kind = BINARY_II_ARCHIVE;
+	} else {
+		archive_close(arc);
+		return NULL;
+	}
+	
+	return arc;
+}
+
+void archive_close(archive* arc) {
+	if (arc != NULL) {
+		fclose(arc->fp);
+		free(arc);
+	}
+}
+
+int archive_walk(archive* arc, archive_visitor visit, void* context) {
+	if (arc->kind == NUFX_ARCHIVE) {
+		return walkNufx(arc, 0, visit, context);
+	} else {
+		return walkBinaryII(arc, visit, context);
+	}
+}
+
+archive_stream* archive_stream_open(archive* arc, const archive_entry* entry) {
+	archive_stream* stream;
+	
+	if ((entry->format != UNCOMPRESSED) && (entry->format != LZW1) && (entry->format != LZW2)) {
+		return NULL;
+	}
+	
+	if ((stream = (archive_stream*) malloc(sizeof(archive_stream))) == NULL) {
+		return NULL;
+	}
+	
+	if (fseek(arc->fp, entry->offset, SEEK_SET) != 0) {
+		free(stream);
+		return NULL;
+	}
+	
+	stream->fp = arc->fp;
+	stream->format = entry->format;
+	stream->remaining = entry->length;
+	stream->left = entry->eof;
+	stream->started = 0;
+	stream->inputLen = 0;
+	stream->inputPos = 0;
+	stream->bits = 0;
+	stream->bitCount = 0;
+	stream->chunkLen = 0;
+	stream->chunkPos = 0;
+	
+	return stream;
+}
+
+long archive_stream_read(archive_stream* stream, char* buf, long len) {
+	long done = 0;
+	
+	while ((done < len) && (stream->left > 0)) {
+		long n = len - done;
+		
+		if (n > stream->left) {
+			n = stream->left;
+		}
+		
+		if (stream->format == UNCOMPRESSED) {
+			if (n > stream->remaining) {
+				n = stream->remaining;
+			}
+			
+			if ((n == 0) || ((n = (long) fread(&buf[done], 1, (size_t) n, stream->fp)) == 0)) {
+				return -1;
+			}
+			
+			stream->remaining -= n;
+		} else {
+			if ((stream->chunkPos == stream->chunkLen) && (nextChunk(stream) != 0)) {
+				return -1;
+			}
+			
+			if (n > stream->chunkLen - stream->chunkPos) {
+				n = stream->chunkLen - stream->chunkPos;
+			}
+			
+			memcpy(&buf[done], &stream->chunk[stream->chunkPos], (size_t) n);
+			stream->chunkPos += (int) n;
+		}
+		
+		done += n;
+		stream->left -= n;
+	}
+	
+	return done;
+}
+
+void archive_stream_close(archive_stream* stream) {
+	free(stream);
+}
@@ -0,0 +1,80 @@
+/*
+ * Read-only access to NuFX (ShrinkIt) and Binary II archives.
+ *
+ * An archive (.shk, .sdk, .bxy, .bny or .bqy) is opened as a flat list of members.
+ * Each member is streamed straight out of the archive, with ShrinkIt's LZW/1 and
+ * LZW/2 compression undone a 4K chunk at a time, so nothing is ever extracted to disk.
+ */
+
+#ifndef _GSGREP_ARCHIVE_H
+#define _GSGREP_ARCHIVE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointers to get abstract datatypes. */
+typedef struct archive archive;
+typedef struct archive_stream archive_stream;
+
+
+/* A member found while walking an archive. */
+typedef struct archive_entry
+{
+	int           fileType;      /* ProDOS file type                                  */
+	unsigned long auxType;
+	int           isDiskImage;   /* a whole disk, in ProDOS block order                */
+	long          eof;           /* length once uncompressed                          */
+	int           format;        /* how the data is compressed                        */
+	long          offset;        /* where the data starts in the archive              */
+	long          length;        /* length of the data in the archive                 */
+} archive_entry;
+
+
+/* Called for each member of an archive, with its path within the archive (e.g.
+   "SUBDIR/FILE").  Return 0 to carry on walking, anything else to stop. */
+typedef int (*archive_visitor)(void* context, const char* path, const archive_entry* entry);
+
+
+/* Returns non-zero if path has the extension of an archive (.shk, .sdk, .bxy, .bny or
+   .bqy). */
+int archive_is_archive_name(const char* path);
+
+
+/* Open the archive at path, returning NULL if it can't be read or isn't a NuFX or
+   Binary II archive. */
+archive* archive_open(const char* path);
+
+
+/* Close an archive opened with archive_open. */
+void archive_close(archive* arc);
+
+
+/* Walk the archive, calling visit for each data fork or disk image it holds.  A NuFX
+   archive inside a Binary II one (.bxy) is walked as though its members were the
+   outer archive's.  Returns 0 once the walk is complete, -1 if the archive is damaged,
+   or the non-zero value returned by visit to stop the walk. */
+int archive_walk(archive* arc, archive_visitor visit, void* context);
+
+
+/* Open a member found by archive_walk, for streaming with archive_stream_read.  This
+   may only be called from within the visitor.  Returns NULL if the member's
+   compression is not understood. */
+archive_stream* archive_stream_open(archive* arc, const archive_entry* entry);
+
+
+/* Read up to len bytes of the member into buf, returning the number of bytes read,
+   0 at the end of the member, or -1 if the archive is damaged. */
+long archive_stream_read(archive_stream* stream, char* buf, long len);
+
+
+/* Close a stream opened with archive_stream_open. */
+void archive_stream_close(archive_stream* stream);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_ARCHIVE_H */
@@ -0,0 +1,188 @@
+/*
+ * Least recently used caches, for gsgrep --serve.
+ *
+ * The entries are found through a hash table of their keys, and kept on a list in
+ * the order they were last used, so that the one to drop is always at its tail.
+ */
+
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+#define HASH_SIZE 256
+
+typedef struct entry {
+	struct entry*  next;         /* in the same hash bucket                      */
+	struct entry*  newer;        /* on the list in order of use                  */
+	struct entry*  older;
+	char*          key;
+	long           stamp;
+	void*          value;
+	long           size;
+} entry;
+
+struct cache {
+	entry*         buckets[HASH_SIZE];
+	entry*         newest;
+	entry*         oldest;
+	long           capacity;
+	long           used;
+	cache_release  release;
+};
+
+
+
+/* Private functions: */
+
+static unsigned int hashKey(const char* key) {
+	unsigned int hash = 5381;
+	
+	while (*key != '\0') {
+		hash = (hash * 33) ^ (unsigned char) *key++;
+	}
+	
+	return hash % HASH_SIZE;
+}
+
+static void unlinkUse(cache* c, entry* e) {
+	if (e->newer != NULL) {
+		e->newer->older = e->older;
+	} else {
+		c->newest = e->older;
+	}
+	
+	if (e->older != NULL) {
+		e->older->newer = e->newer;
+	} else {
+		c->oldest = e->newer;
+	}
+}
+
+static void linkNewest(cache* c, entry* e) {
+	e->newer = NULL;
+	e->older = c->newest;
+	
+	if (c->newest != NULL) {
+		c->newest->newer = e;
+	} else {
+		c->oldest = e;
+	}
+	
+	c->newest = e;
+}
+
+/* Drops an entry from the cache, releasing its value. */
+static void drop(cache* c, entry* e) {
+	entry** link = &c->buckets[hashKey(e->key)];
+	
+	while (*link != e) {
+		link = &(*link)->next;
+	}
+	
+	*link = e->next;
+	unlinkUse(c, e);
+	
+	c->used -= e->size;
+	c->release(e->value);
+	free(e->key);
+	free(e);
+}
+
+static entry* find(cache* c, const char* key) {
+	entry* e = c->buckets[hashKey(key)];
+	
+	while ((e != NULL) && strcmp(e->key, key)) {
+		e = e->next;
+	}
+	
+	return e;
+}
+
+
+
+/* Public functions: */
+
+cache* cache_new(long capacity, cache_release release) {
+	cache* c = (cache*) calloc(1, sizeof(cache));
+	
+	if (c != NULL) {
+		c->capacity = capacity;
+		c->release = release;
+	}
+	
+	return c;
+}
+
+void* cache_get(cache* c, const char* key, long stamp) {
+	entry* e = find(c, key);
+	
+	if (e == NULL) {
+		return NULL;
+	}
+	
+	if (e->stamp != stamp) {
+		drop(c, e);
+		return NULL;
+	}
+	
+	unlinkUse(c, e);
+	linkNewest(c, e);
+	
+	return e->value;
+}
+
+int cache_put(cache* c, const char* key, long stamp, void* value, long size) {
+	entry* e;
+	unsigned int hash;
+	
+	if (size > c->capacity) {
+		return -1;
+	}
+	
+	if ((e = find(c, key)) != NULL) {
+		drop(c, e);
+	}
+	
+	if ((e = (entry*) malloc(sizeof(entry))) == NULL) {
+		return -1;
+	}
+	
+	if ((e->key = (char*) malloc(strlen(key) + 1)) == NULL) {
+		free(e);
+		return -1;
+	}
+	
+	while (c->used + size > c->capacity) {
+		drop(c, c->oldest);
+	}
+	
+	strcpy(e->key, key);
+	e->stamp = stamp;
+	e->value = value;
+	e->size = size;
+	
+	hash = hashKey(key);
+	e->next = c->buckets[hash];
+	c->buckets[hash] = e;
+	linkNewest(c, e);
+	c->used += size;
+	
+	return 0;
+}
+
+void cache_free(cache* c) {
+	if (c == NULL) {
+		return;
+	}
+	
+	while (c->oldest != NULL) {
+		drop(c, c->oldest);
+	}
+	
+	free(c);
+}
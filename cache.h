@@ -0,0 +1,52 @@
+/*
+ * Least recently used caches, for gsgrep --serve.
+ *
+ * A cache holds values under string keys, each with a size given when it is put in
+ * and a stamp (such as the modification time of the file it came from) that must match
+ * for it to be found again.  Once the sizes of the values add up to more than the
+ * capacity of the cache, the values used least recently are released to make room.
+ */
+
+#ifndef _GSGREP_CACHE_H
+#define _GSGREP_CACHE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct cache cache;
+
+
+/* Releases a value that has been dropped from a cache. */
+typedef void (*cache_release)(void* value);
+
+
+/* Create an empty cache holding values whose sizes add up to at most capacity, which
+   are released with release once they are dropped.  Returns NULL if there is not
+   enough memory. */
+cache* cache_new(long capacity, cache_release release);
+
+
+/* Returns the value held under key, making it the most recently used, or NULL if there
+   is none.  A value put in with a different stamp is dropped, and NULL returned. */
+void* cache_get(cache* c, const char* key, long stamp);
+
+
+/* Put value into the cache under key, in place of any value already held under it,
+   dropping the least recently used values until it fits.  Returns 0, or -1 if it is
+   bigger than the whole cache or there is not enough memory, in which case the value
+   is left to the caller. */
+int cache_put(cache* c, const char* key, long stamp, void* value, long size);
+
+
+/* Release a cache and all of the values in it. */
+void cache_free(cache* c);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_CACHE_H */
@@ -0,0 +1,230 @@
+/*
+ * Text extraction from Apple II document formats.
+ *
+ * AppleWorks word processor files follow Apple II File Type Note $1A/0000: a 300 byte
+ * header and then a list of two byte line records, where text records carry one
+ * paragraph each (ending it with a carriage return if bit 7 of their count is set).
+ */
+
+#include "decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+#define PRODOS_T_AWP           0x1A
+
+#define AWP_HEADER_LEN         300
+#define AWP_MIN_VERSION        183   /* non-zero from AppleWorks 3.0, which adds 2 bytes */
+
+#define AWP_CARRIAGE_RETURN    0xD0
+#define AWP_END                0xFF
+#define AWP_RULER              0xFF
+
+#define INPUT_LEN              512
+#define LINE_LEN               256
+
+#define CR                     '\015'
+
+struct decoder {
+	decode_source  read;
+	void*          source;
+	int            started;      /* the header has been skipped                  */
+	int            finished;     /* the end record has been seen                 */
+	
+	unsigned char  input[INPUT_LEN];
+	int            inputLen;
+	int            inputPos;
+	int            inputError;
+	
+	char           line[LINE_LEN];  /* text decoded from the current record      */
+	int            lineLen;
+	int            linePos;
+};
+
+
+
+/* Private functions: */
+
+/* Return the next byte of the raw file, or -1 at its end or on an error. */
+static int nextByte(decoder* dec) {
+	if (dec->inputPos == dec->inputLen) {
+		long n = dec->read(dec->source, (char*) dec->input, INPUT_LEN);
+		
+		if (n <= 0) {
+			dec->inputError = (n < 0);
+			return -1;
+		}
+		
+		dec->inputLen = (int) n;
+		dec->inputPos = 0;
+	}
+	
+	return dec->input[dec->inputPos++];
+}
+
+static int skipBytes(decoder* dec, long count) {
+	while (count-- > 0) {
+		if (nextByte(dec) < 0) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+/* Decode the next AppleWorks line record into dec->line. */
+static int nextAwpRecord(decoder* dec) {
+	int low, high, length, indent, count, i, c, newer = 0;
+	
+	if (!dec->started) {
+		for (i = 0; i < AWP_HEADER_LEN; i++) {
+			if ((c = nextByte(dec)) < 0) {
+				return -1;
+			}
+			
+			if (i == AWP_MIN_VERSION) {
+				newer = (c != 0);
+			}
+		}
+		
+		if (newer && (skipBytes(dec, 2) != 0)) {
+			return -1;
+		}
+		
+		dec->started = 1;
+	}
+	
+	dec->lineLen = 0;
+	dec->linePos = 0;
+	
+	if (((low = nextByte(dec)) < 0) || ((high = nextByte(dec)) < 0)) {
+		return -1;
+	}
+	
+	if ((low == AWP_END) && (high == AWP_END)) {
+		dec->finished = 1;
+		return 0;
+	} else if (high == AWP_CARRIAGE_RETURN) {
+		dec->line[dec->lineLen++] = CR;
+		return 0;
+	} else if (high > AWP_CARRIAGE_RETURN) {
+		/* a formatting command, with no text */
+		return 0;
+	}
+	
+	/* a text record: its length, the indent (or a ruler), and the length of the text */
+	length = low | (high << 8);
+	
+	if ((length < 2) || ((indent = nextByte(dec)) < 0)) {
+		return -1;
+	}
+	
+	if (indent == AWP_RULER) {
+		return skipBytes(dec, length - 1);
+	}
+	
+	if ((count = nextByte(dec)) < 0) {
+		return -1;
+	}
+	
+	for (i = 0; i < (count & 0x7F); i++) {
+		if ((c = nextByte(dec)) < 0) {
+			return -1;
+		}
+		
+		/* control characters mark bold, underlining and the like; AppleWorks 3.0
+		   keeps its tabs as $16 and their fill as $17. */
+		if (c == 0x16) {
+			dec->line[dec->lineLen++] = '\t';
+		} else if (c == 0x0B) {
+			dec->line[dec->lineLen++] = ' ';
+		} else if (c >= 0x20) {
+			dec->line[dec->lineLen++] = (char) c;
+		}
+	}
+	
+	if ((count & 0x80) != 0) {
+		dec->line[dec->lineLen++] = CR;
+	}
+	
+	return skipBytes(dec, length - 2 - (count & 0x7F));
+}
+
+
+
+/* Public functions: */
+int decode_has_decoder(int fileType, unsigned int auxType) {
+	(void) auxType;
+	
+	return (fileType == PRODOS_T_AWP);
+}
+
+decoder* decode_open(int fileType, unsigned int auxType, decode_source read, void* source) {
+	decoder* dec;
+	
+	/* there is only the one decoder so far */
+	(void) fileType;
+	(void) auxType;
+	
+	if ((dec = (decoder*) malloc(sizeof(decoder))) == NULL) {
+		return NULL;
+	}
+	
+	dec->read = read;
+	dec->source = source;
+	dec->started = 0;
+	dec->finished = 0;
+	dec->inputLen = 0;
+	dec->inputPos = 0;
+	dec->inputError = 0;
+	dec->lineLen = 0;
+	dec->linePos = 0;
+	
+	return dec;
+}
+
+long decode_read(decoder* dec, char* buf, long len) {
+	long done = 0;
+	
+	while (done < len) {
+		long n;
+		
+		if (dec->linePos == dec->lineLen) {
+			if (dec->finished) {
+				break;
+			}
+			
+			if (nextAwpRecord(dec) != 0) {
+				/* a file that stops short of its end record is taken as ending there */
+				if (dec->inputError) {
+					return -1;
+				}
+				
+				dec->finished = 1;
+			}
+			
+			continue;
+		}
+		
+		n = dec->lineLen - dec->linePos;
+		
+		if (n > len - done) {
+			n = len - done;
+		}
+		
+		memcpy(&buf[done], &dec->line[dec->linePos], (size_t) n);
+		dec->linePos += (int) n;
+		done += n;
+	}
+	
+	return done;
+}
+
+void decode_close(decoder* dec) {
+	free(dec);
+}
@@ -0,0 +1,50 @@
+/*
+ * Text extraction from Apple II document formats.
+ *
+ * A decoder sits between a file and the matcher, reading the file's raw bytes and
+ * streaming out only the text they hold, a line at a time, with lines ending in CR.
+ * Formatting, rulers and the other binary parts of the document are skipped without
+ * ever building the document in memory.
+ */
+
+#ifndef _GSGREP_DECODE_H
+#define _GSGREP_DECODE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct decoder decoder;
+
+
+/* Reads up to len bytes of the raw file into buf, returning the number of bytes read,
+   0 at the end of the file, or -1 on an error. */
+typedef long (*decode_source)(void* source, char* buf, long len);
+
+
+/* Returns non-zero if files of this ProDOS file and aux type are read through a
+   decoder rather than searched as they are. */
+int decode_has_decoder(int fileType, unsigned int auxType);
+
+
+/* Start decoding a file of a type for which decode_has_decoder is true, reading it
+   through read from source.  Returns NULL if there is not enough memory. */
+decoder* decode_open(int fileType, unsigned int auxType, decode_source read, void* source);
+
+
+/* Read up to len bytes of the file's text into buf, returning the number of bytes
+   read, 0 at the end of the text, or -1 if the file could not be read or is damaged. */
+long decode_read(decoder* dec, char* buf, long len);
+
+
+/* Finish with a decoder opened with decode_open. */
+void decode_close(decoder* dec);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_DECODE_H */
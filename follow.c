@@ -0,0 +1,269 @@
+/*
+ * Waiting for files to grow, for gsgrep --follow.
+ *
+ * On Linux each file is watched with inotify, along with the directory holding it, so
+ * that a new file given the name of one being followed is noticed as soon as it is
+ * created or moved into place.  A single epoll loop waits on the inotify descriptor for
+ * all of the files together, and wakes every so often even without an event, so that
+ * changes made where inotify can't see them (on a network file system) are still found.
+ * Elsewhere the files are simply looked at again every so often.  GS/OS has no way of
+ * waiting for a file to change, so the IIGS can't follow files.
+ */
+
+#include "follow.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#endif
+
+/* how long to wait for an event before looking at every file anyway, in seconds. */
+#define FOLLOW_INTERVAL 1
+
+#define FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIRECTORY_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+typedef struct {
+	char*        path;
+	const char*  name;          /* the last part of path                         */
+	int          fileWatch;     /* the watch on the file, or -1 if it has none   */
+	int          dirWatch;      /* the watch on the directory holding it         */
+} followed;
+
+struct follow_set {
+	followed*    files;
+	int          count;
+	int          size;
+	int          inotifyFd;
+	int          epollFd;
+};
+
+
+
+/* Private functions: */
+
+#ifdef __linux__
+
+/* Watches the file named by f afresh, as it may be a new file. */
+static void watchFile(follow_set* set, followed* f) {
+	if (f->fileWatch >= 0) {
+		inotify_rm_watch(set->inotifyFd, f->fileWatch);
+	}
+	
+	f->fileWatch = inotify_add_watch(set->inotifyFd, f->path, FILE_EVENTS);
+}
+
+/* Watches the directory holding the file named by f. */
+static int watchDirectory(follow_set* set, followed* f) {
+	char* dir;
+	int len = (int) (f->name - f->path);
+	
+	if (len == 0) {
+		return (f->dirWatch = inotify_add_watch(set->inotifyFd, ".", DIRECTORY_EVENTS));
+	}
+	
+	if ((dir = (char*) malloc(len + 1)) == NULL) {
+		return -1;
+	}
+	
+	// the directory is the path up to (and including) its last slash.
+	//
+	memcpy(dir, f->path, len);
+	dir[len] = '\0';
+	
+	f->dirWatch = inotify_add_watch(set->inotifyFd, dir, DIRECTORY_EVENTS);
+	free(dir);
+	
+	return f->dirWatch;
+}
+
+/* Marks the files that the event concerns as changed, returning how many there are. */
+static int applyEvent(follow_set* set, struct inotify_event* event, unsigned char* changed) {
+	int i, count = 0;
+	
+	for (i = 0; i < set->count; i++) {
+		followed* f = &set->files[i];
+		
+		if (event->wd == f->fileWatch) {
+			if ((event->mask & IN_IGNORED) != 0) {
+				f->fileWatch = -1;
+			}
+		} else if ((event->wd != f->dirWatch) || (event->len == 0) || strcmp(event->name, f->name)) {
+			continue;
+		} else {
+			watchFile(set, f);
+		}
+		
+		if (!changed[i]) {
+			changed[i] = 1;
+			count++;
+		}
+	}
+	
+	return count;
+}
+
+#endif
+
+
+
+/* Public functions: */
+
+follow_set* follow_new(void) {
+	#ifdef __ORCAC__
+	return NULL;
+	#else
+	follow_set* set = (follow_set*) malloc(sizeof(follow_set));
+	
+	if (set == NULL) {
+		return NULL;
+	}
+	
+	set->files = NULL;
+	set->count = 0;
+	set->size = 0;
+	set->inotifyFd = -1;
+	set->epollFd = -1;
+	
+	#ifdef __linux__
+	{
+		struct epoll_event ev;
+		
+		if (((set->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) ||
+			((set->epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0)) {
+			follow_free(set);
+			return NULL;
+		}
+		
+		ev.events = EPOLLIN;
+		ev.data.fd = set->inotifyFd;
+		
+		if (epoll_ctl(set->epollFd, EPOLL_CTL_ADD, set->inotifyFd, &ev) < 0) {
+			follow_free(set);
+			return NULL;
+		}
+	}
+	#endif
+	
+	return set;
+	#endif
+}
+
+int follow_add(follow_set* set, const char* path) {
+	followed* f;
+	
+	if (set->count == set->size) {
+		int size = (set->size == 0) ? 8 : set->size * 2;
+		followed* bigger = (followed*) realloc(set->files, size * sizeof(followed));
+		
+		if (bigger == NULL) {
+			return -1;
+		}
+		
+		set->files = bigger;
+		set->size = size;
+	}
+	
+	f = &set->files[set->count];
+	
+	if ((f->path = (char*) malloc(strlen(path) + 1)) == NULL) {
+		return -1;
+	}
+	
+	strcpy(f->path, path);
+	f->name = strrchr(f->path, '/') ? strrchr(f->path, '/') + 1 : f->path;
+	f->fileWatch = -1;
+	f->dirWatch = -1;
+	
+	#ifdef __linux__
+	if (watchDirectory(set, f) < 0) {
+		free(f->path);
+		return -1;
+	}
+	
+	watchFile(set, f);
+	#endif
+	
+	return set->count++;
+}
+
+int follow_wait(follow_set* set, unsigned char* changed) {
+	int i, count = 0;
+	
+	memset(changed, 0, set->count);
+	
+	#ifdef __linux__
+	{
+		long events[1024];  /* long, to be aligned as the events in it need */
+		struct epoll_event ev;
+		long len, pos;
+		int n;
+		
+		if ((n = epoll_wait(set->epollFd, &ev, 1, FOLLOW_INTERVAL * 1000)) < 0) {
+			return -1;
+		}
+		
+		if (n > 0) {
+			while ((len = read(set->inotifyFd, events, sizeof(events))) > 0) {
+				for (pos = 0; pos < len; ) {
+					struct inotify_event* event = (struct inotify_event*) ((char*) events + pos);
+					
+					count += applyEvent(set, event, changed);
+					pos += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			
+			if ((len < 0) && (errno != EAGAIN)) {
+				return -1;
+			}
+			
+			return count;
+		}
+	}
+	#elif !defined(__ORCAC__)
+	sleep(FOLLOW_INTERVAL);
+	#endif
+	
+	// nothing has been heard of the files for a while, so all of them are looked at.
+	//
+	for (i = 0; i < set->count; i++) {
+		changed[i] = 1;
+	}
+	
+	return set->count;
+}
+
+void follow_free(follow_set* set) {
+	int i;
+	
+	if (set == NULL) {
+		return;
+	}
+	
+	for (i = 0; i < set->count; i++) {
+		free(set->files[i].path);
+	}
+	
+	#ifdef __linux__
+	if (set->epollFd >= 0) {
+		close(set->epollFd);
+	}
+	
+	if (set->inotifyFd >= 0) {
+		close(set->inotifyFd);
+	}
+	#endif
+	
+	free(set->files);
+	free(set);
+}
@@ -0,0 +1,46 @@
+/*
+ * Waiting for files to grow, for gsgrep --follow.
+ *
+ * A follow set watches a number of files by name, and waits until one or more of them
+ * may have changed: been added to, truncated, or replaced by a new file of the same
+ * name (as a log is when it is rotated).  It only says which of them to look at; the
+ * caller reads what is new and works out what happened from the file itself.
+ */
+
+#ifndef _GSGREP_FOLLOW_H
+#define _GSGREP_FOLLOW_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct follow_set follow_set;
+
+
+/* Create an empty set, or return NULL if there is not enough memory or files can't be
+   followed here. */
+follow_set* follow_new(void);
+
+
+/* Start watching the file named path, which need not exist yet.  Returns its id (the
+   number of files added before it), or -1 if it can't be watched. */
+int follow_add(follow_set* set, const char* path);
+
+
+/* Wait until one or more of the files may have changed, and set changed[id] to 1 for
+   each of them (and 0 for the others).  Returns the number of files changed, or -1 on
+   an error. */
+int follow_wait(follow_set* set, unsigned char* changed);
+
+
+/* Stop watching the files and release the set. */
+void follow_free(follow_set* set);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_FOLLOW_H */
@@ -7,24 +7,36 @@ A grep tool for the Apple IIGS
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <gsos.h>
-#include <shell.h>
 #include "re.h"
+#include "patset.h"
 #include "parg.h"
+#include "output.h"
+#include "scan.h"
+#include "search.h"
+#include "follow.h"
+#include "cache.h"
+#include "serve.h"
+#include "results.h"
+#include "timewin.h"
+#include "reverse.h"
+#include "progress.h"
+#include "stats.h"
+#include "prodos.h"
+#include "archive.h"
+#include "decode.h"
+
+/* the ProDOS file types are needed everywhere, as they decide which of the files in a
+   disk image are text. */
+#define __APPLE2__ 1
+
+#include "a2.filetype.h"
 
 #ifdef __ORCAC__
 #define AppleIIGS 1
 
+#include <gsos.h>
 #include <shell.h>
 
-static const char SPINNER[] = "-\|/-";
-static int spinnerIdx = 0;
-static int userAbort = 0;
-
-#define __APPLE2__ 1
-
-#include "a2.filetype.h"
-
 /* On the Apple IIGS, we need this pragma to ensure that the code/data is split across
    multiple segments as it exceeds a single bank  */
 #pragma memorymodel 1
@@ -37,6 +49,23 @@ static int userAbort = 0;
    
 #define SLASH_N '\015'
 
+/* the console driver has no colour, so matches are highlighted in inverse video. */
+#define HIGHLIGHT_ON "\017"
+#define HIGHLIGHT_OFF "\016"
+
+#else
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLASH_N '\012'
+
+#define HIGHLIGHT_ON "\033[01;31m\033[K"
+#define HIGHLIGHT_OFF "\033[m\033[K"
+
+#endif
+
 typedef struct {
 	int fileType;
 	int auxType;
@@ -46,10 +75,11 @@ typedef struct {
 static FileType textFileTypes[] = {
 	{PRODOS_T_TXT, 0x00, 0},
 	{PRODOS_T_GWP, PRODOS_AUX_T_GWP_TEACH, 1},
-	{PRODOS_T_SRC, 0x00, 0}
+	{PRODOS_T_SRC, 0x00, 0},
+	{PRODOS_T_AWP, 0x00, 0}
 };
 
-#define NUMBER_OF_TEXT_FILETYPES 3
+#define NUMBER_OF_TEXT_FILETYPES 4
 
 static int isSearchableText(int fileType, int auxType) {
 	int result = 0;
@@ -69,313 +99,2394 @@ static int isSearchableText(int fileType, int auxType) {
 	return result;
 }
 
-static void update_spinner(void) {
-	StopGSPB stopParm;
-	ConsoleOutGSPB consoleOutParm;
-	char ch = SPINNER[spinnerIdx++];
-	
-	consoleOutParm.pCount = 1;
-	
-	if (spinnerIdx > 3) {
-		spinnerIdx = 0;
-	}
-	
-	consoleOutParm.ch = ch;
-	ConsoleOutGS(&consoleOutParm);
-	consoleOutParm.ch = 010;
-	ConsoleOutGS(&consoleOutParm);
-	
-	stopParm.pCount = 1;
-	stopParm.flag = 0;
-	StopGS(&stopParm);
+/* lower cases text; in a regular expression (with escapes set), the letter after a
+   backslash is left alone, as \W or \B mean something other than \w or \b. */
+static void toLower(char *text, int escapes) {
+	int idx = 0;
 	
-	if (stopParm.flag != 0) {
-		userAbort = 1;
+	while (text[idx] != 0x00) {
+		if (escapes && (text[idx] == '\\') && (text[idx + 1] != 0x00)) {
+			idx++;
+		} else if (isalpha(text[idx])) {
+			text[idx] = _tolower(text[idx]);
+		}
+		
+		idx++;
 	}
 }
 
-#else
+enum Options {  /* bits */
+	IgnoreCase = 1,
+	ShowFilename = 2,
+	ShowLineNumbers = 4,
+	Recursive = 8,
+	AllFiles = 16,
+	OnlyMatching = 32,
+	Color = 64,
+	JsonOutput = 128,
+	CountOnly = 256,
+	PatternIds = 512,
+	PatternCounts = 1024,
+	FixedStrings = 2048,
+	WordRegexp = 4096,
+	LineRegexp = 8192
+};
 
-#define SLASH_N '\012'
+/* line endings other than a specific character. */
+enum LineEndings {
+	NativeLineEnd = -1,   /* CR on the IIGS, LF elsewhere (or as translated on stdin) */
+	AutoLineEnd = -2      /* whichever of LF or CR is seen first in the file */
+};
 
-static int isSearchableText(int fileType, int auxType) {
-	return 1;
-}
+static int lineEnding = NativeLineEnd;
 
-#endif
+/* with --group, the group whose text -o and --color show in place of the whole match. */
+static int outputGroup = 0;
 
-static void toLower(char *text) {
-	int idx = 0;
+/* with --since or --until, the window of time whose lines are searched, and the times
+   and --time-format as they were given. */
+static time_window *timeWindow = NULL;
+static char *sinceTime = NULL;
+static char *untilTime = NULL;
+static char *timeFormat = NULL;
+
+/* with -m, the most lines to report from each file (or -1 for all of them), and with
+   --reverse, whether files are searched from their last line back to their first. */
+static long maxCount = -1;
+static int reverseSearch = 0;
+
+/* the backtracking a pattern may do on a line before it is matched by the automaton
+   instead (0 for no limit), and the patterns that have gone over it so far. */
+#define DEFAULT_BACKTRACK_LIMIT 100000L
+
+static long backtrackLimit = DEFAULT_BACKTRACK_LIMIT;
+static int fallbacksWarned = 0;
+
+/* copies of the patterns given with -e and -f, in the order they were given, before
+   they are compiled (which waits until -i has been seen). */
+static char **patternList = NULL;
+static int patternListCount = 0;
+static int patternListSize = 0;
+
+/* values returned by parg for options that only have a long form. */
+enum LongOptions {
+	ColorOption = 1000,
+	JsonOption,
+	LineEndingOption,
+	FilesFromOption,
+	NullOption,
+	PatternIdsOption,
+	PatternCountsOption,
+	MaxErrorsOption,
+	GroupOption,
+	FollowOption,
+	CacheDirOption,
+	SinceOption,
+	UntilOption,
+	TimeFormatOption,
+	ReverseOption,
+	ProgressOption,
+	StatsOption,
+	ProfileRegexOption,
+	BacktrackLimitOption
+};
+
+static const struct parg_option longOptions[] = {
+	{"only-matching", PARG_NOARG, NULL, 'o'},
+	{"count", PARG_NOARG, NULL, 'c'},
+	{"fixed-strings", PARG_NOARG, NULL, 'F'},
+	{"word-regexp", PARG_NOARG, NULL, 'w'},
+	{"line-regexp", PARG_NOARG, NULL, 'x'},
+	{"color", PARG_OPTARG, NULL, ColorOption},
+	{"colour", PARG_OPTARG, NULL, ColorOption},
+	{"json", PARG_NOARG, NULL, JsonOption},
+	{"null-data", PARG_NOARG, NULL, 'z'},
+	{"line-ending", PARG_REQARG, NULL, LineEndingOption},
+	{"files-from", PARG_REQARG, NULL, FilesFromOption},
+	{"max-errors", PARG_REQARG, NULL, MaxErrorsOption},
+	{"group", PARG_REQARG, NULL, GroupOption},
+	{"follow", PARG_NOARG, NULL, FollowOption},
+	{"cache-dir", PARG_REQARG, NULL, CacheDirOption},
+	{"since", PARG_REQARG, NULL, SinceOption},
+	{"until", PARG_REQARG, NULL, UntilOption},
+	{"time-format", PARG_REQARG, NULL, TimeFormatOption},
+	{"max-count", PARG_REQARG, NULL, 'm'},
+	{"reverse", PARG_NOARG, NULL, ReverseOption},
+	{"progress", PARG_NOARG, NULL, ProgressOption},
+	{"stats", PARG_OPTARG, NULL, StatsOption},
+	{"profile-regex", PARG_NOARG, NULL, ProfileRegexOption},
+	{"backtrack-limit", PARG_REQARG, NULL, BacktrackLimitOption},
+	{"null", PARG_NOARG, NULL, NullOption},
+	{"regexp", PARG_REQARG, NULL, 'e'},
+	{"file", PARG_REQARG, NULL, 'f'},
+	{"pattern-ids", PARG_NOARG, NULL, PatternIdsOption},
+	{"pattern-counts", PARG_NOARG, NULL, PatternCountsOption},
+	{NULL, 0, NULL, 0}
+};
+
+static void printPrefix(char *infile, long lineNumber, int standardInput, int options) {
+	if (((options & ShowFilename) != 0) && !standardInput) {
+		out_str(infile);
+		out_char(':');
+	}
 	
-	do {
-		if (isalpha(text[idx])) {
-			text[idx] = _tolower(text[idx]);
+	if ((options & ShowLineNumbers) != 0) {
+		out_long(lineNumber);
+		out_char(':');
+	}
+}
+
+/* with --pattern-ids, prints the ids (counting from 1) of the patterns that matched
+   the line. */
+static void printPatternIds(unsigned char *hits, int count) {
+	int i, first = 1;
+	
+	for (i = 0; i < count; i++) {
+		if (hits[i]) {
+			if (!first) {
+				out_char(',');
+			}
+			
+			out_long(i + 1);
+			first = 0;
 		}
-		
-		idx++;
-	} while (text[idx] != 0x00);	
+	}
+	
+	out_char(':');
+}
+
+/* ends an output line; with -z, lines are written nul terminated as they were read. */
+static void printLineEnd(void) {
+	if (lineEnding == 0) {
+		out_char('\0');
+	} else {
+		out_newline();
+	}
 }
 
-static int readline(char *buf, size_t len, FILE* fin) {
-	if (fgets(buf, len, fin) == NULL) {
-		return feof(fin) ? 0 : -1;
+static void printMatch(char *text, int length, int options) {
+	if ((options & Color) != 0) {
+		out_str(HIGHLIGHT_ON);
+		out_write(text, length);
+		out_str(HIGHLIGHT_OFF);
+	} else {
+		out_write(text, length);
 	}
+}
+
+/* with --group, narrows the match just found by patset_find_next down to the chosen
+   group, returning 0 if the group took no part in it. */
+static int selectGroup(pattern_set *patterns, char *buf, int *start, int *matchLength) {
+	int spans[2 * NFA_MAX_GROUPS];
 	
-	len = strlen(buf);
+	if (outputGroup == 0) {
+		return 1;
+	}
 	
-	if (buf[len-1] == '\n') {
-		buf[--len] = '\0';
+	if ((patset_submatches(patterns, buf, spans) < outputGroup) || (spans[2 * outputGroup - 2] < 0)) {
+		return 0;
 	}
 	
+	*start = spans[2 * outputGroup - 2];
+	*matchLength = spans[2 * outputGroup - 1] - *start;
+	
 	return 1;
 }
 
-enum Options {  /* bits */
-	IgnoreCase = 1,
-	ShowFilename = 2,
-	ShowLineNumbers = 4,
-	Recursive = 8,
-	AllFiles = 16
-};
+/* prints the text of a group, and where it starts and ends, as a JSON object. */
+static void printJsonSpan(char *text, int start, int end) {
+	out_str("{\"match\":");
+	out_json_string(&text[start], end - start);
+	out_str(",\"start\":");
+	out_long(start);
+	out_str(",\"end\":");
+	out_long(end);
+	out_char('}');
+}
 
-static int grep(re_t regex, char *infile, int options) {
-	char buf[BUFSIZ], bufCopy[BUFSIZ];
-	int rc, matched = 0, matchLength = 0, lineNumber = 1;
-	int standardInput = 0;
+/* prints a matching line.  the line is walked once with patset_find_next, so -o and
+   --color never need to re-run the matcher from every offset; buf is the text the
+   patterns were matched against, and text is the original (pre case-folding) line.
+   hits, if not NULL, holds the patterns that matched, for --pattern-ids. */
+static void printLine(pattern_set *patterns, char *buf, char *text, char *infile, long lineNumber,
+					  int standardInput, unsigned char *hits, int options) {
+	int offset = 0, last = 0, start, matchLength;
 	
-	FILE *fin = stdin;
+	if ((options & (OnlyMatching | Color)) == 0) {
+		printPrefix(infile, lineNumber, standardInput, options);
+		
+		if (hits != NULL) {
+			printPatternIds(hits, patset_count(patterns));
+		}
+		
+		out_str(text);
+		printLineEnd();
+		return;
+	}
 	
-	if (!infile) {
-		standardInput = 1;
-	} else if (infile && !strcmp(infile, "-")) {
-		infile = "(standard input)";
-		standardInput = 1;
-	} else if(infile && (fin = fopen(infile, "r")) == NULL) {
-		perror(infile);
-		return -1;
+	if ((options & OnlyMatching) == 0) {
+		printPrefix(infile, lineNumber, standardInput, options);
+		
+		if (hits != NULL) {
+			printPatternIds(hits, patset_count(patterns));
+		}
 	}
 	
-	while ((rc = readline(buf, sizeof buf, fin)) > 0) {
-		// keep the original in case the case is changed.
-		strcpy(bufCopy, buf);
+	while ((start = patset_find_next(patterns, buf, &offset, &matchLength)) >= 0) {
+		if (selectGroup(patterns, buf, &start, &matchLength) && (matchLength > 0)) {
+			if ((options & OnlyMatching) != 0) {
+				printPrefix(infile, lineNumber, standardInput, options);
+				
+				if (hits != NULL) {
+					printPatternIds(hits, patset_count(patterns));
+				}
+				
+				printMatch(&text[start], matchLength, options);
+				printLineEnd();
+			} else {
+				out_write(&text[last], start - last);
+				printMatch(&text[start], matchLength, options);
+				last = start + matchLength;
+			}
+		}
 		
-		if ((options & IgnoreCase) != 0) {
-			toLower(buf);
+		if (offset < 0) {
+			break;
+		}
+	}
+	
+	if ((options & OnlyMatching) == 0) {
+		out_str(&text[last]);
+		printLineEnd();
+	}
+}
+
+/* prints a matching line as a JSON Lines "match" record, carrying the line number,
+   the byte offset of the start of the line within the file, and the span of every
+   match in the line, with the spans of its groups if the pattern has any (and, given
+   hits, the ids of the patterns that matched). */
+static void printJsonMatch(pattern_set *patterns, char *buf, char *text, char *path, long lineNumber,
+						   long lineOffset, unsigned char *hits) {
+	int i, groups;
+	int offset = 0, start, matchLength, first = 1;
+	int spans[2 * NFA_MAX_GROUPS];
+	
+	out_str("{\"type\":\"match\",\"path\":");
+	out_json_string(path, strlen(path));
+	out_str(",\"line_number\":");
+	out_long(lineNumber);
+	out_str(",\"offset\":");
+	out_long(lineOffset);
+	out_str(",\"text\":");
+	out_json_string(text, strlen(text));
+	out_str(",\"submatches\":[");
+	
+	while ((start = patset_find_next(patterns, buf, &offset, &matchLength)) >= 0) {
+		if (!first) {
+			out_char(',');
 		}
 		
-		if(rc = re_matchp(regex, buf, &matchLength) >= 0) {
-			matched = 1;
+		first = 0;
+		
+		out_str("{\"match\":");
+		out_json_string(&text[start], matchLength);
+		out_str(",\"start\":");
+		out_long(start);
+		out_str(",\"end\":");
+		out_long(start + matchLength);
+		
+		if ((groups = patset_submatches(patterns, buf, spans)) > 0) {
+			out_str(",\"groups\":[");
 			
-			if (((options & ShowFilename) != 0) && !standardInput) {
-				if ((options & ShowLineNumbers) != 0) {
-					printf("%s:%d:%s\n", infile, lineNumber, bufCopy);
+			for (i = 0; i < groups; i++) {
+				if (i > 0) {
+					out_char(',');
+				}
+				
+				if (spans[2 * i] < 0) {
+					out_str("null");
 				} else {
-					printf("%s:%s\n", infile, bufCopy);
+					printJsonSpan(text, spans[2 * i], spans[2 * i + 1]);
 				}
-			} else {
-				printf("%s\n", bufCopy);
 			}
+			
+			out_char(']');
 		}
 		
-		lineNumber++;
+		out_char('}');
 		
-		#ifdef AppleIIGS
-		update_spinner();
-		
-		if (userAbort) {
-			matched = -1;
-			break;
-		}
-		#endif
-
-		if (rc < 0) {
+		if (offset < 0) {
 			break;
 		}
 	}
 	
+	out_char(']');
 	
-	if (rc < 0) {
-		perror(infile ? infile : "(standard input)");
-		matched = -1;
+	if (hits != NULL) {
+		out_str(",\"patterns\":[");
+		
+		for (i = 0, first = 1; i < patset_count(patterns); i++) {
+			if (hits[i]) {
+				if (!first) {
+					out_char(',');
+				}
+				
+				out_long(i + 1);
+				first = 0;
+			}
+		}
+		
+		out_char(']');
 	}
 	
-	if (fin && fin != stdin && fclose(fin) == EOF) {
-		perror(infile);
-		return -1;
+	out_char('}');
+	out_newline();
+}
+
+/* prints the JSON Lines "end" record that closes off the search of a file, with the
+   number of lines each pattern matched if there are patternCounts. */
+static void printJsonEnd(char *path, long matchingLines, long bytesSearched,
+						 long *patternCounts, int count) {
+	int i;
+	
+	out_str("{\"type\":\"end\",\"path\":");
+	out_json_string(path, strlen(path));
+	out_str(",\"matches\":");
+	out_long(matchingLines);
+	out_str(",\"bytes\":");
+	out_long(bytesSearched);
+	
+	if (patternCounts != NULL) {
+		out_str(",\"pattern_matches\":[");
+		
+		for (i = 0; i < count; i++) {
+			if (i > 0) {
+				out_char(',');
+			}
+			
+			out_long(patternCounts[i]);
+		}
+		
+		out_char(']');
 	}
 	
-	return matched;
+	out_str("}");
+	out_newline();
 }
 
-typedef enum {
-	Error = 0,
-	Stopped = 1,
-	Matched = 2,
-	Unmatched = 3
-} GrepResult;
+/* the input is read in blocks of this size. */
+#define BLOCK_SIZE 16384
 
-GrepResult grepFile(re_t regex, char *thisFile, int flags) {
-	ResultBuf255 filename;
-	GSString255 inputName;
-	
-	Init_WildcardGSPB initwildparms;
-	NextWildcardGSPB nextwildparms;
-	StopGSPB stopparms;
-	
-	GrepResult result = Unmatched;
-	int rc = 0;
+static char block[BLOCK_SIZE];
+
+typedef struct {
+	pattern_set *patterns;
+	char *infile;
+	int standardInput;
+	int options;
+	long *patternCounts;  /* the lines matched by each pattern, if wanted */
+	search_context *search;
+} SearchState;
+
+/* called by the search with each matching line, to report it. */
+static int reportLine(void *data, search_line *line) {
+	SearchState *state = (SearchState *) data;
+	unsigned char *ids;
+	long started = stats_clock();
+	int i;
 	
-	inputName.length = strlen(thisFile);
-	strcpy(inputName.text, thisFile);
+	if (state->patternCounts != NULL) {
+		for (i = 0; i < patset_count(state->patterns); i++) {
+			state->patternCounts[i] += line->hits[i];
+		}
+	}
 	
-	initwildparms.pCount = 2;
-	initwildparms.wFile = &inputName;
-	initwildparms.flags = 0x8000; /* treat '?' as '=' */
+	ids = ((state->options & PatternIds) != 0) ? line->hits : NULL;
 	
-	if ((flags & Recursive) != 0x00) {
-		initwildparms.flags |= 0x2000;
+	if ((state->options & JsonOutput) != 0) {
+		printJsonMatch(state->patterns, line->matched, line->text, state->infile, line->lineNumber,
+					   line->offset, ids);
+	} else if ((state->options & (CountOnly | PatternCounts)) == 0) {
+		printLine(state->patterns, line->matched, line->text, state->infile, line->lineNumber,
+				  state->standardInput, ids, state->options);
 	}
 	
-	InitWildcardGS(&initwildparms);
+	// the time taken to write out the line is part of the time the search took, but goes
+	// down to the output.
+	//
+	stats_add_time(STATS_SCAN, -stats_time(STATS_OUTPUT, started));
 	
-	filename.bufSize = 255;
-	filename.bufString.length = 0;
-	filename.bufString.text[0] = 0x00;
+	// with -m, the search stops once it has as many lines as are wanted.
+	//
+	return ((maxCount >= 0) && (search_matches(state->search) >= maxCount)) ? 1 : 0;
+}
+
+/* reads up to len bytes of input into buf, returning the number of bytes read, 0 at
+   the end of the input, or -1 on an error. */
+typedef long (*ReadFunction)(void *source, char *buf, long len);
+
+static long readStream(void *source, char *buf, long len) {
+	size_t n = fread(buf, 1, len, (FILE *) source);
 	
-	nextwildparms.pCount = 3;
-	nextwildparms.pathName = &filename;
+	return ((n == 0) && ferror((FILE *) source)) ? -1 : (long) n;
+}
+
+static long readImageFile(void *source, char *buf, long len) {
+	return prodos_file_read((prodos_file *) source, buf, len);
+}
+
+static long readArchiveMember(void *source, char *buf, long len) {
+	return archive_stream_read((archive_stream *) source, buf, len);
+}
+
+/* reads no further than the end of a range of a file. */
+typedef struct {
+	FILE *file;
+	long remaining;
+} RangeReader;
+
+static long readRange(void *source, char *buf, long len) {
+	RangeReader *range = (RangeReader *) source;
+	long n;
 	
-	stopparms.pCount = 1;
+	if (len > range->remaining) {
+		len = range->remaining;
+	}
 	
-	do {
-		StopGS(&stopparms);
-		
-		if (stopparms.flag == 1) {
-			result = Stopped;
-		} else {
-			NextWildcardGS(&nextwildparms);
-			
-			if (filename.bufString.length > 0) {
-				// We need to look at the filetype of the file, and only check it
-				// if it is a source or text file (unless -a) has been specified by
-				// the user.
-				//
-				if (nextwildparms.fileType != PRODOS_T_DIR) {
-					if ((flags & AllFiles) ||
-						isSearchableText(nextwildparms.fileType, nextwildparms.auxType))
-					{
-						filename.bufString.text[filename.bufString.length] = 0x00;
-						
-						rc = grep(regex, filename.bufString.text, flags);
-						
-						if (rc >= 0) {
-							result = Matched;
-						} else if (rc < 0) {
-							result = Error;
-						}
-					}
-				}
-			}
-		}
-	} while ((result >= Matched) && (filename.bufString.length > 0));
+	if ((n = readStream(range->file, buf, len)) > 0) {
+		range->remaining -= n;
+	}
 	
-	return result;
+	return n;
 }
 
-int main(int argc, char *argv[]) {
-	int matched = 0, errors = 0;
-	int i, opt, flags = ShowFilename;
-	struct parg_state ps;
-	int optend;
-	re_t regex;
-	char *res;
-	GrepResult grepResult = Unmatched;
+/* starts the search of an input named infile, whose lines end with lineEnd.  returns 0,
+   or -1 if there is not enough memory. */
+static int startSearch(SearchState *state, pattern_set *patterns, char *infile, int standardInput,
+					   char lineEnd, int options) {
+	int searchOptions = 0;
 	
-	parg_init(&ps);
+	state->patterns = patterns;
+	state->infile = infile;
+	state->standardInput = standardInput;
+	state->options = options;
+	state->patternCounts = NULL;
 	
-	// reorder the arguments for parg, so that options are first.
-	//
-	optend = parg_reorder(argc, argv, "inHh", NULL);
+	if ((options & IgnoreCase) != 0) {
+		searchOptions |= SEARCH_IGNORE_CASE;
+	}
 	
-	// parse the options and arguments.
-	//
-	while ((errors == 0) && (opt = parg_getopt(&ps, optend, argv, "ainHhR")) != -1) {
-		switch(opt) {
-		case 'a': flags |= AllFiles;  	  
-			break;
-			
-		case 'i': flags |= IgnoreCase;  	  
-			break;
-			
-		case 'n': flags |= ShowLineNumbers;
-			break;
-			
-		case 'H': flags |= ShowFilename;
-			break;
-			
-		case 'h': flags &= (~ShowFilename);
-			break;
-			
-		case 'R': flags |= Recursive;
-			break;
-			
-		case 1:
-			break;
-			
-		case '?':
-			/*if (ps.optopt == 'o') {
-			printf("option -o requires an argument\n");
-			} else {*/
-			errors = 1;
-			//}
-			break;
-			
-		default: 
-			errors = 1;
-		}
+	if ((options & (ShowLineNumbers | JsonOutput)) != 0) {
+		searchOptions |= SEARCH_LINE_NUMBERS;
 	}
 	
-	if ((errors != 0) || (i = ps.optind) >= argc) {
-		fprintf(stderr, "usage: %s [-inHhR] (regex) [files...]\n", argv[0]);
-		return 2;
+	if ((options & (PatternIds | PatternCounts)) != 0) {
+		searchOptions |= SEARCH_PATTERN_HITS;
+		state->patternCounts = (long *) calloc(patset_count(patterns), sizeof(long));
 	}
 	
-	// if we are ignoring case, then set the pattern to be all lower case.  the
-	// same will be done as we read the file(s).
-	//
-	if ((flags & IgnoreCase) != 0) {
-		toLower(argv[i]);
+	if (stats_enabled()) {
+		searchOptions |= SEARCH_COUNT_LINES;
 	}
 	
-	// compile the regular expression.
-	regex = re_compile(argv[i++]);
+	state->search = search_new(patterns, searchOptions, lineEnd, reportLine, state);
 	
-	if (!regex) { 
-		perror("failed to compile regular expression."); 
-		return 2; 
+	if ((state->search == NULL) ||
+		(((searchOptions & SEARCH_PATTERN_HITS) != 0) && (state->patternCounts == NULL))) {
+		fprintf(stderr, "%s: not enough memory\n", infile);
+		search_free(state->search);
+		free(state->patternCounts);
+		return -1;
 	}
 	
-	if (i <= (argc - 0)) {
-		do {
-			grepResult = grepFile(regex, argv[i], flags);
-			
+	if (stats_enabled()) {
+		search_set_clock(state->search, stats_clock);
+	}
+	
+	return 0;
+}
+
+/* with --line-ending=auto, takes the line ending from the first block of an input. */
+static void detectLineEnd(SearchState *state, long len) {
+	if ((lineEnding == AutoLineEnd) && (search_offset(state->search) == 0)) {
+		if (scan_find_char(block, len, '\012') != NULL) {
+			search_set_line_end(state->search, '\012');
+		} else if (scan_find_char(block, len, '\015') != NULL) {
+			search_set_line_end(state->search, '\015');
+		}
+	}
+}
+
+/* warns of the patterns that went over the backtracking limit in the search of infile,
+   which are matched by the automaton from now on. */
+static void warnFallbacks(pattern_set *patterns, char *infile) {
+	int i, order;
+	
+	// only patterns still listed for this query are named; the set may outlive the list.
+	//
+	for (i = 0; (i < patset_count(patterns)) && (i < patternListCount); i++) {
+		if ((order = patset_fell_back(patterns, i)) > fallbacksWarned) {
+			fprintf(stderr, "%s: %s backtracked over %ld steps on a line; matching it without backtracking from here on\n",
+					infile, patternList[i], backtrackLimit);
+		}
+	}
+	
+	stats_count(STATS_FALLBACKS, patset_fallbacks(patterns) - fallbacksWarned);
+	fallbacksWarned = patset_fallbacks(patterns);
+}
+
+/* reports the totals for an input once it has been searched to its end, and finishes
+   with its search. */
+static void endSearch(SearchState *state) {
+	search_stats stats;
+	long n, started = stats_clock();
+	
+	if ((state->options & JsonOutput) != 0) {
+		printJsonEnd(state->infile, search_matches(state->search), search_offset(state->search),
+					 ((state->options & PatternCounts) != 0) ? state->patternCounts : NULL,
+					 patset_count(state->patterns));
+	} else if ((state->options & PatternCounts) != 0) {
+		for (n = 0; n < patset_count(state->patterns); n++) {
+			printPrefix(state->infile, 0, state->standardInput, state->options & ShowFilename);
+			out_long(n + 1);
+			out_char(':');
+			out_long(state->patternCounts[n]);
+			out_newline();
+		}
+	} else if ((state->options & CountOnly) != 0) {
+		printPrefix(state->infile, 0, state->standardInput, state->options & ShowFilename);
+		out_long(search_matches(state->search));
+		out_newline();
+	}
+	
+	out_flush();
+	stats_time(STATS_OUTPUT, started);
+	
+	if (patset_fallbacks(state->patterns) > fallbacksWarned) {
+		warnFallbacks(state->patterns, state->infile);
+	}
+	
+	// the time spent matching lines was counted as part of scanning them.
+	//
+	if (stats_enabled()) {
+		search_get_stats(state->search, &stats);
+		stats_count(STATS_LINES, stats.lines);
+		stats_count(STATS_CANDIDATES, stats.candidates);
+		stats_count(STATS_MATCHES, stats.matches);
+		stats_add_time(STATS_MATCH, stats.matchTime);
+		stats_add_time(STATS_SCAN, -stats.matchTime);
+	}
+	
+	search_free(state->search);
+	free(state->patternCounts);
+}
+
+/* searches everything that readFunction reads from source, reporting it as infile.
+   lines end with defaultLineEnd unless another line ending has been chosen. */
+static int searchInput(pattern_set *patterns, char *infile, ReadFunction readFunction, void *source,
+					   int standardInput, char defaultLineEnd, int options) {
+	SearchState state;
+	long n, started, searchStarted = stats_clock();
+	int rc = 0, matched = 0, stop;
+	
+	if (startSearch(&state, patterns, infile, standardInput,
+					(lineEnding >= 0) ? (char) lineEnding : defaultLineEnd, options) < 0) {
+		return -1;
+	}
+	
+	progress_file(infile);
+	errno = 0;
+	
+	do {
+		started = stats_clock();
+		n = readFunction(source, block, BLOCK_SIZE);
+		stats_time(STATS_READ, started);
+		
+		if (n < 0) {
+			rc = -1;
+			break;
+		}
+		
+		stats_count(STATS_BYTES, n);
+		detectLineEnd(&state, n);
+		
+		// the last partial line is only searched once the input is known to have ended.
+		//
+		started = stats_clock();
+		stop = (n == 0) ? search_finish(state.search) : search_feed(state.search, block, n);
+		stats_time(STATS_SCAN, started);
+		
+		if (stop < 0) {
+			break;
+		}
+		
+		if (progress_update(n)) {
+			matched = -1;
+			break;
+		}
+	} while (n > 0);
+	
+	if (matched == 0) {
+		matched = (search_matches(state.search) > 0) ? 1 : 0;
+	}
+	
+	// images and archives fail without an errno when their contents are damaged.
+	//
+	if (rc < 0 && matched >= 0) {
+		if (errno != 0) {
+			perror(infile);
+		} else {
+			fprintf(stderr, "%s: unable to read file\n", infile);
+		}
+		
+		matched = -1;
+	}
+	
+	endSearch(&state);
+	
+	stats_count(STATS_FILES, 1);
+	stats_file(infile, stats_clock() - searchStarted);
+	
+	return matched;
+}
+
+static long readDecoded(void *source, char *buf, long len) {
+	return decode_read((decoder *) source, buf, len);
+}
+
+/* passed as the type of a file whose ProDOS type isn't known. */
+#define NO_FILE_TYPE -1
+
+/* searches a file of the given ProDOS type as searchInput does, reading only the
+   text of documents that would otherwise be searched byte for byte. */
+static int searchFile(pattern_set *patterns, char *infile, ReadFunction readFunction, void *source,
+					  int standardInput, int fileType, int auxType, char defaultLineEnd,
+					  int options) {
+	decoder *dec;
+	int matched;
+	
+	if ((fileType == NO_FILE_TYPE) || !decode_has_decoder(fileType, auxType)) {
+		return searchInput(patterns, infile, readFunction, source, standardInput,
+						   defaultLineEnd, options);
+	}
+	
+	if ((dec = decode_open(fileType, auxType, readFunction, source)) == NULL) {
+		fprintf(stderr, "%s: not enough memory\n", infile);
+		return -1;
+	}
+	
+	// the decoded text always ends its lines with CR.
+	//
+	matched = searchInput(patterns, infile, readDecoded, dec, standardInput, '\015', options);
+	
+	decode_close(dec);
+	
+	return matched;
+}
+
+static long readReverse(void *source, char *buf, long len) {
+	return reverse_read((reverse_reader *) source, buf, len);
+}
+
+/* with --since, --until or --reverse, searches a file read from fin by seeking about
+   it: only the lines that fall within the window of time, which are found without
+   reading the rest of the file, and last line first with --reverse. */
+static int searchRange(pattern_set *patterns, char *infile, FILE *fin, int standardInput,
+					   char defaultLineEnd, int options) {
+	RangeReader range;
+	reverse_reader *reverse;
+	char lineEnd = (lineEnding >= 0) ? (char) lineEnding : defaultLineEnd;
+	long start, end, n;
+	int matched;
+	
+	// with --line-ending=auto, the line ending is taken from the start of the file.
+	//
+	if (lineEnding == AutoLineEnd) {
+		n = (long) fread(block, 1, BLOCK_SIZE, fin);
+		
+		if (scan_find_char(block, n, '\012') != NULL) {
+			lineEnd = '\012';
+		} else if (scan_find_char(block, n, '\015') != NULL) {
+			lineEnd = '\015';
+		}
+	}
+	
+	if (timeWindow != NULL) {
+		n = timewin_range(timeWindow, fin, lineEnd, &start, &end);
+	} else if ((n = fseek(fin, 0L, SEEK_END)) == 0) {
+		start = 0;
+		n = ((end = ftell(fin)) < 0) ? -1 : 0;
+	}
+	
+	if ((n != 0) || (!reverseSearch && (fseek(fin, start, SEEK_SET) != 0))) {
+		perror(infile);
+		return -1;
+	}
+	
+	if (!reverseSearch) {
+		range.file = fin;
+		range.remaining = end - start;
+		
+		return searchInput(patterns, infile, readRange, &range, standardInput, lineEnd, options);
+	}
+	
+	if ((reverse = reverse_open(fin, lineEnd, start, end, BLOCK_SIZE)) == NULL) {
+		fprintf(stderr, "%s: not enough memory\n", infile);
+		return -1;
+	}
+	
+	matched = searchInput(patterns, infile, readReverse, reverse, standardInput, lineEnd, options);
+	
+	reverse_close(reverse);
+	
+	return matched;
+}
+
+/* searches a file read from fin as searchFile does, keeping to the window of time given
+   by --since and --until, and searching backwards with --reverse, for files that are
+   searched as they are. */
+static int searchStream(pattern_set *patterns, char *infile, FILE *fin, int standardInput,
+						int fileType, int auxType, char defaultLineEnd, int options) {
+	if (((timeWindow != NULL) || reverseSearch) &&
+		((fileType == NO_FILE_TYPE) || !decode_has_decoder(fileType, auxType))) {
+		return searchRange(patterns, infile, fin, standardInput, defaultLineEnd, options);
+	}
+	
+	return searchFile(patterns, infile, readStream, fin, standardInput, fileType, auxType,
+					  defaultLineEnd, options);
+}
+
+#ifndef AppleIIGS
+
+/* the caches a server keeps between queries, which are NULL unless serving. */
+static cache *patternCache = NULL;
+static cache *fileCache = NULL;
+static cache *directoryCache = NULL;
+
+/* with --cache-dir, the results of earlier searches. */
+static result_cache *resultCache = NULL;
+
+/* the bytes of file contents and of directory listings a server keeps, and the
+   biggest file it will keep. */
+#define FILE_CACHE_SIZE (64L * 1024L * 1024L)
+#define DIRECTORY_CACHE_SIZE (4L * 1024L * 1024L)
+#define MAX_CACHED_FILE (4L * 1024L * 1024L)
+
+/* grepCached returns this for a file it leaves to be read as usual. */
+#define NOT_CACHED -3
+
+static void releasePatterns(void *patterns) {
+	patset_free((pattern_set *) patterns);
+}
+
+/* the time a file or directory was last changed, to the nanosecond where it is kept,
+   so that a cached copy of it can be told to be out of date. */
+static long modifiedStamp(struct stat *info) {
+	#ifdef __APPLE__
+	return (long) ((unsigned long) info->st_mtimespec.tv_sec * 1000000000UL + info->st_mtimespec.tv_nsec);
+	#else
+	return (long) ((unsigned long) info->st_mtim.tv_sec * 1000000000UL + info->st_mtim.tv_nsec);
+	#endif
+}
+
+/* identifies a file or directory, whatever path it is reached by. */
+static void identityKey(char *key, struct stat *info) {
+	sprintf(key, "%lu:%lu", (unsigned long) info->st_dev, (unsigned long) info->st_ino);
+}
+
+/* the contents of a file, held in memory. */
+typedef struct {
+	long length;
+	char *data;
+} FileContents;
+
+typedef struct {
+	FileContents *contents;
+	long pos;
+} MemoryReader;
+
+static long readMemory(void *source, char *buf, long len) {
+	MemoryReader *reader = (MemoryReader *) source;
+	
+	if (len > reader->contents->length - reader->pos) {
+		len = reader->contents->length - reader->pos;
+	}
+	
+	memcpy(buf, &reader->contents->data[reader->pos], len);
+	reader->pos += len;
+	
+	return len;
+}
+
+/* reads a whole file of length bytes into memory, returning NULL if it can't be read
+   or turns out to be some other length. */
+static FileContents *loadFile(char *infile, long length) {
+	FileContents *contents;
+	FILE *fin;
+	long n = -1;
+	
+	if ((contents = (FileContents *) malloc(sizeof(FileContents) + length + 1)) == NULL) {
+		return NULL;
+	}
+	
+	contents->length = length;
+	contents->data = (char *) (contents + 1);
+	
+	if ((fin = fopen(infile, "rb")) != NULL) {
+		n = (long) fread(contents->data, 1, length + 1, fin);
+		fclose(fin);
+	}
+	
+	if (n != length) {
+		free(contents);
+		return NULL;
+	}
+	
+	return contents;
+}
+
+/* with --serve, searches a file from the copy of it kept in memory, if it is small
+   enough to keep, reading it into memory first if there is no copy of it as it now
+   is.  returns as grep() does, or NOT_CACHED. */
+static int grepCached(pattern_set *patterns, char *infile, int options) {
+	struct stat info;
+	char key[48];
+	MemoryReader reader;
+	int matched, kept = 1;
+	
+	if ((stat(infile, &info) != 0) || !S_ISREG(info.st_mode) || (info.st_size > MAX_CACHED_FILE)) {
+		return NOT_CACHED;
+	}
+	
+	identityKey(key, &info);
+	reader.contents = (FileContents *) cache_get(fileCache, key, modifiedStamp(&info));
+	reader.pos = 0;
+	
+	if ((reader.contents == NULL) || (reader.contents->length != (long) info.st_size)) {
+		if ((reader.contents = loadFile(infile, (long) info.st_size)) == NULL) {
+			return NOT_CACHED;
+		}
+		
+		kept = (cache_put(fileCache, key, modifiedStamp(&info), reader.contents,
+						  reader.contents->length) == 0);
+	}
+	
+	matched = searchFile(patterns, infile, readMemory, &reader, 0, NO_FILE_TYPE, 0, SLASH_N, options);
+	
+	if (!kept) {
+		free(reader.contents);
+	}
+	
+	return matched;
+}
+
+#endif
+
+/* searches a named file (as opposed to the standard input). */
+static int grepNamedFile(pattern_set *patterns, char *infile, int fileType, int auxType, int options) {
+	FILE *fin;
+	long started;
+	int matched, rc;
+	
+	#ifndef AppleIIGS
+	// a server searches the files it has kept without opening them, unless only part of
+	// them is to be searched, or they are to be searched backwards.
+	//
+	if ((fileCache != NULL) && (timeWindow == NULL) && !reverseSearch &&
+		((matched = grepCached(patterns, infile, options)) != NOT_CACHED)) {
+		return matched;
+	}
+	#endif
+	
+	started = stats_clock();
+	fin = fopen(infile, "rb");
+	stats_time(STATS_OPEN, started);
+	
+	if (fin == NULL) {
+		perror(infile);
+		return -1;
+	}
+	
+	// files are read untranslated, so by default lines end with the native SLASH_N.
+	//
+	matched = searchStream(patterns, infile, fin, 0, fileType, auxType, SLASH_N, options);
+	
+	started = stats_clock();
+	rc = fclose(fin);
+	stats_time(STATS_OPEN, started);
+	
+	if (rc == EOF) {
+		perror(infile);
+		return -1;
+	}
+	
+	return matched;
+}
+
+#ifndef AppleIIGS
+
+/* with --cache-dir, writes out the results kept for a file if it hasn't changed since
+   they were recorded, and otherwise searches it, recording them. */
+static int grepRecorded(pattern_set *patterns, char *infile, int fileType, int auxType, int options) {
+	struct stat info;
+	results_file file;
+	int matched, recording;
+	
+	if ((stat(infile, &info) != 0) || !S_ISREG(info.st_mode)) {
+		return grepNamedFile(patterns, infile, fileType, auxType, options);
+	}
+	
+	file.device = (unsigned long) info.st_dev;
+	file.inode = (unsigned long) info.st_ino;
+	file.size = (long) info.st_size;
+	file.modified = modifiedStamp(&info);
+	
+	if ((matched = results_replay(resultCache, infile, &file)) >= 0) {
+		return matched;
+	}
+	
+	recording = (results_record(resultCache, infile, &file) == 0);
+	matched = grepNamedFile(patterns, infile, fileType, auxType, options);
+	
+	if (recording) {
+		results_finish(resultCache, (matched < 0) ? -1 : matched);
+	}
+	
+	return matched;
+}
+
+#endif
+
+static int grep(pattern_set *patterns, char *infile, int fileType, int auxType, int options) {
+	// stdin is left in text mode, so its lines end with whatever the runtime translates
+	// SLASH_N to.
+	//
+	if (!infile || !strcmp(infile, "-")) {
+		return searchStream(patterns, "(standard input)", stdin, 1, fileType, auxType, '\n',
+							options);
+	}
+	
+	#ifndef AppleIIGS
+	if (resultCache != NULL) {
+		return grepRecorded(patterns, infile, fileType, auxType, options);
+	}
+	#endif
+	
+	return grepNamedFile(patterns, infile, fileType, auxType, options);
+}
+
+/* grepImage and grepArchive return this when the file turns out not to be one. */
+#define NOT_A_CONTAINER -2
+
+typedef struct {
+	pattern_set *patterns;
+	char *imageName;
+	prodos_image *image;
+	int options;
+	int matched;
+} ImageSearch;
+
+/* merges the result of searching one member of an image or archive into matched,
+   returning -1 if the user has asked to stop. */
+static int mergeMember(int *matched, int rc) {
+	if (rc > 0 && *matched == 0) {
+		*matched = 1;
+	} else if (rc < 0) {
+		*matched = -1;
+		
+		if (progress_stopped()) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+static int searchImageFile(void *context, const char *path, const prodos_entry *entry) {
+	ImageSearch *search = (ImageSearch *) context;
+	prodos_file *file;
+	char *name;
+	int rc;
+	
+	// the files in an image have their real ProDOS types, so they are picked out
+	// exactly as they would be on a IIGS.
+	//
+	if (((search->options & AllFiles) == 0) && !isSearchableText(entry->fileType, entry->auxType)) {
+		stats_count(STATS_SKIPPED, 1);
+		return 0;
+	}
+	
+	if ((name = (char *) malloc(strlen(search->imageName) + strlen(path) + 2)) == NULL) {
+		return -1;
+	}
+	
+	sprintf(name, "%s/%s", search->imageName, path);
+	
+	if ((file = prodos_file_open(search->image, entry)) == NULL) {
+		fprintf(stderr, "%s: unable to read file\n", name);
+		search->matched = -1;
+		free(name);
+		return 0;
+	}
+	
+	// Apple II text always ends its lines with CR, whatever the host.
+	//
+	rc = searchFile(search->patterns, name, readImageFile, file, 0, entry->fileType,
+					entry->auxType, '\015', search->options);
+	
+	prodos_file_close(file);
+	free(name);
+	
+	return mergeMember(&search->matched, rc);
+}
+
+/* searches the text files of an open image, reporting them as files within the
+   directory imageName, then closes it.  returns as grep() does. */
+static int searchImage(pattern_set *patterns, char *imageName, prodos_image *image, int options) {
+	ImageSearch search;
+	
+	search.patterns = patterns;
+	search.imageName = imageName;
+	search.image = image;
+	search.options = options;
+	search.matched = 0;
+	
+	if (prodos_walk(image, searchImageFile, &search) < 0) {
+		if (!progress_stopped()) {
+			fprintf(stderr, "%s: unable to read directory\n", imageName);
+		}
+		
+		search.matched = -1;
+	}
+	
+	prodos_close(image);
+	
+	return search.matched;
+}
+
+/* searches the text files held in a ProDOS disk image, as though the image were a
+   directory.  returns as grep() does, or NOT_A_CONTAINER. */
+static int grepImage(pattern_set *patterns, char *imageName, int options) {
+	prodos_image *image;
+	
+	if ((image = prodos_open(imageName)) == NULL) {
+		return NOT_A_CONTAINER;
+	}
+	
+	return searchImage(patterns, imageName, image, options);
+}
+
+typedef struct {
+	pattern_set *patterns;
+	char *archiveName;
+	archive *archive;
+	int options;
+	int matched;
+} ArchiveSearch;
+
+/* a disk in an archive is unpacked into memory and searched like any other image. */
+static int searchArchiveDisk(ArchiveSearch *search, char *name, archive_stream *stream, long length) {
+	unsigned char *disk;
+	prodos_image *image;
+	int rc;
+	
+	if ((disk = (unsigned char *) malloc(length)) == NULL) {
+		fprintf(stderr, "%s: not enough memory to unpack disk\n", name);
+		return -1;
+	}
+	
+	if (archive_stream_read(stream, (char *) disk, length) != length) {
+		fprintf(stderr, "%s: unable to read file\n", name);
+		rc = -1;
+	} else if ((image = prodos_open_memory(disk, length)) == NULL) {
+		rc = 0;
+	} else {
+		rc = searchImage(search->patterns, name, image, search->options);
+	}
+	
+	free(disk);
+	return rc;
+}
+
+static int searchArchiveMember(void *context, const char *path, const archive_entry *entry) {
+	ArchiveSearch *search = (ArchiveSearch *) context;
+	archive_stream *stream;
+	char *name;
+	int rc;
+	
+	// members keep their ProDOS types in the archive, so they are picked out just as
+	// files in an image are.
+	//
+	if (!entry->isDiskImage && ((search->options & AllFiles) == 0) &&
+		!isSearchableText(entry->fileType, (int) entry->auxType)) {
+		stats_count(STATS_SKIPPED, 1);
+		return 0;
+	}
+	
+	if ((name = (char *) malloc(strlen(search->archiveName) + strlen(path) + 2)) == NULL) {
+		return -1;
+	}
+	
+	sprintf(name, "%s/%s", search->archiveName, path);
+	
+	if ((stream = archive_stream_open(search->archive, entry)) == NULL) {
+		fprintf(stderr, "%s: unsupported compression\n", name);
+		search->matched = -1;
+		free(name);
+		return 0;
+	}
+	
+	if (entry->isDiskImage) {
+		rc = searchArchiveDisk(search, name, stream, entry->eof);
+	} else {
+		rc = searchFile(search->patterns, name, readArchiveMember, stream, 0, entry->fileType,
+						(int) entry->auxType, '\015', search->options);
+	}
+	
+	archive_stream_close(stream);
+	free(name);
+	
+	return mergeMember(&search->matched, rc);
+}
+
+/* searches the text files held in a ShrinkIt or Binary II archive, as though the
+   archive were a directory.  returns as grep() does, or NOT_A_CONTAINER. */
+static int grepArchive(pattern_set *patterns, char *archiveName, int options) {
+	ArchiveSearch search;
+	
+	if ((search.archive = archive_open(archiveName)) == NULL) {
+		return NOT_A_CONTAINER;
+	}
+	
+	search.patterns = patterns;
+	search.archiveName = archiveName;
+	search.options = options;
+	search.matched = 0;
+	
+	if (archive_walk(search.archive, searchArchiveMember, &search) < 0) {
+		if (!progress_stopped()) {
+			fprintf(stderr, "%s: damaged archive\n", archiveName);
+		}
+		
+		search.matched = -1;
+	}
+	
+	archive_close(search.archive);
+	
+	return search.matched;
+}
+
+/* searches a file, or the files within it if it is a disk image or an archive. */
+static int grepOneFile(pattern_set *patterns, char *infile, int options) {
+	int rc = NOT_A_CONTAINER;
+	
+	if (prodos_is_image_name(infile)) {
+		rc = grepImage(patterns, infile, options);
+	} else if (archive_is_archive_name(infile)) {
+		rc = grepArchive(patterns, infile, options);
+	}
+	
+	if (rc == NOT_A_CONTAINER) {
+		rc = grep(patterns, infile, NO_FILE_TYPE, 0, options);
+	}
+	
+	return rc;
+}
+
+typedef enum {
+	Error = 0,
+	Stopped = 1,
+	Matched = 2,
+	Unmatched = 3
+} GrepResult;
+
+#ifdef AppleIIGS
+
+GrepResult grepFile(pattern_set *patterns, char *thisFile, int flags) {
+	ResultBuf255 filename;
+	GSString255 inputName;
+	
+	Init_WildcardGSPB initwildparms;
+	NextWildcardGSPB nextwildparms;
+	StopGSPB stopparms;
+	
+	GrepResult result = Unmatched;
+	long started;
+	int rc = 0;
+	
+	inputName.length = strlen(thisFile);
+	strcpy(inputName.text, thisFile);
+	
+	initwildparms.pCount = 2;
+	initwildparms.wFile = &inputName;
+	initwildparms.flags = 0x8000; /* treat '?' as '=' */
+	
+	if ((flags & Recursive) != 0x00) {
+		initwildparms.flags |= 0x2000;
+	}
+	
+	InitWildcardGS(&initwildparms);
+	
+	filename.bufSize = 255;
+	filename.bufString.length = 0;
+	filename.bufString.text[0] = 0x00;
+	
+	nextwildparms.pCount = 3;
+	nextwildparms.pathName = &filename;
+	
+	stopparms.pCount = 1;
+	
+	do {
+		StopGS(&stopparms);
+		
+		if (stopparms.flag == 1) {
+			result = Stopped;
+		} else {
+			started = stats_clock();
+			NextWildcardGS(&nextwildparms);
+			stats_time(STATS_TRAVERSE, started);
+			
+			if (filename.bufString.length > 0) {
+				filename.bufString.text[filename.bufString.length] = 0x00;
+				rc = 0;
+				
+				// We need to look at the filetype of the file, and only check it
+				// if it is a source or text file (unless -a) has been specified by
+				// the user.  Disk images and archives are searched as directories.
+				//
+				if (nextwildparms.fileType != PRODOS_T_DIR) {
+					if (prodos_is_image_name(filename.bufString.text) ||
+						archive_is_archive_name(filename.bufString.text)) {
+						rc = grepOneFile(patterns, filename.bufString.text, flags);
+					} else if ((nextwildparms.fileType == PRODOS_T_LBR) &&
+							   ((nextwildparms.auxType == PRODOS_AUX_T_LBR_SHRINKIT) ||
+								(nextwildparms.auxType == PRODOS_AUX_T_LBR_BINARY_II))) {
+						// an archive without the usual suffix, found by its type
+						rc = grepArchive(patterns, filename.bufString.text, flags);
+						
+						if (rc == NOT_A_CONTAINER) {
+							rc = (flags & AllFiles) ? grep(patterns, filename.bufString.text, NO_FILE_TYPE, 0, flags) : 0;
+						}
+					} else if ((flags & AllFiles) ||
+						isSearchableText(nextwildparms.fileType, nextwildparms.auxType))
+					{
+						rc = grep(patterns, filename.bufString.text, nextwildparms.fileType,
+								  nextwildparms.auxType, flags);
+					} else {
+						stats_count(STATS_SKIPPED, 1);
+					}
+				}
+				
+				if (rc > 0) {
+					result = Matched;
+				} else if (rc < 0) {
+					result = progress_stopped() ? Stopped : Error;
+				}
+			}
+		}
+	} while ((result >= Matched) && (filename.bufString.length > 0));
+	
+	return result;
+}
+
+#else
+
+/* merges the result of searching one file into that of a set of files. */
+static GrepResult mergeResult(GrepResult result, GrepResult fileResult) {
+	if ((fileResult == Stopped) || (result == Stopped)) {
+		return Stopped;
+	} else if ((fileResult == Error) || (result == Error)) {
+		return Error;
+	} else if ((fileResult == Matched) || (result == Matched)) {
+		return Matched;
+	}
+	
+	return Unmatched;
+}
+
+/* the names of the entries in a directory (other than . and ..), one after another,
+   each nul terminated. */
+typedef struct {
+	long length;
+	char *names;
+} DirectoryListing;
+
+/* reads the names in a directory, returning NULL if it can't be read. */
+static DirectoryListing *listDirectory(char *dirName) {
+	DirectoryListing *listing, *bigger;
+	DIR *dir;
+	struct dirent *dirEntry;
+	long size = 1024, len;
+	
+	if ((dir = opendir(dirName)) == NULL) {
+		return NULL;
+	}
+	
+	if ((listing = (DirectoryListing *) malloc(sizeof(DirectoryListing) + size)) == NULL) {
+		closedir(dir);
+		return NULL;
+	}
+	
+	listing->length = 0;
+	
+	while ((dirEntry = readdir(dir)) != NULL) {
+		if (!strcmp(dirEntry->d_name, ".") || !strcmp(dirEntry->d_name, "..")) {
+			continue;
+		}
+		
+		len = strlen(dirEntry->d_name) + 1;
+		
+		if (listing->length + len > size) {
+			size = size * 2 + len;
+			
+			if ((bigger = (DirectoryListing *) realloc(listing, sizeof(DirectoryListing) + size)) == NULL) {
+				free(listing);
+				closedir(dir);
+				return NULL;
+			}
+			
+			listing = bigger;
+		}
+		
+		memcpy((char *) (listing + 1) + listing->length, dirEntry->d_name, len);
+		listing->length += len;
+	}
+	
+	closedir(dir);
+	listing->names = (char *) (listing + 1);
+	
+	return listing;
+}
+
+/* returns the names in a directory, which the caller frees.  a server keeps a copy of
+   them, for as long as the directory is unchanged. */
+static DirectoryListing *readDirectory(char *dirName, struct stat *info) {
+	DirectoryListing *listing, *copy;
+	char key[48];
+	
+	if (directoryCache == NULL) {
+		return listDirectory(dirName);
+	}
+	
+	identityKey(key, info);
+	
+	if ((listing = (DirectoryListing *) cache_get(directoryCache, key, modifiedStamp(info))) == NULL) {
+		if ((listing = listDirectory(dirName)) == NULL) {
+			return NULL;
+		}
+		
+		if (cache_put(directoryCache, key, modifiedStamp(info), listing,
+					  sizeof(DirectoryListing) + listing->length) < 0) {
+			return listing;
+		}
+	}
+	
+	// the search of a subdirectory may push this listing out of the cache, so it is
+	// worked from a copy.
+	//
+	if ((copy = (DirectoryListing *) malloc(sizeof(DirectoryListing) + listing->length)) != NULL) {
+		copy->length = listing->length;
+		copy->names = (char *) (copy + 1);
+		memcpy(copy->names, listing->names, listing->length);
+	}
+	
+	return copy;
+}
+
+GrepResult grepFile(pattern_set *patterns, char *thisFile, int flags) {
+	struct stat info;
+	DirectoryListing *listing;
+	GrepResult result = Unmatched;
+	char *path, *name;
+	long started = stats_clock();
+	int rc, isDirectory;
+	
+	isDirectory = strcmp(thisFile, "-") && (stat(thisFile, &info) == 0) && S_ISDIR(info.st_mode);
+	stats_time(STATS_TRAVERSE, started);
+	
+	if (isDirectory) {
+		if ((flags & Recursive) == 0) {
+			fprintf(stderr, "%s: Is a directory\n", thisFile);
+			stats_count(STATS_SKIPPED, 1);
+			return Unmatched;
+		}
+		
+		started = stats_clock();
+		listing = readDirectory(thisFile, &info);
+		stats_time(STATS_TRAVERSE, started);
+		
+		if (listing == NULL) {
+			perror(thisFile);
+			return Error;
+		}
+		
+		for (name = listing->names; (result != Stopped) && (name < listing->names + listing->length);
+			 name += strlen(name) + 1) {
+			if ((path = (char *) malloc(strlen(thisFile) + strlen(name) + 2)) == NULL) {
+				result = Error;
+				break;
+			}
+			
+			if (thisFile[strlen(thisFile) - 1] == '/') {
+				sprintf(path, "%s%s", thisFile, name);
+			} else {
+				sprintf(path, "%s/%s", thisFile, name);
+			}
+			
+			result = mergeResult(result, grepFile(patterns, path, flags));
+			free(path);
+		}
+		
+		free(listing);
+		return result;
+	}
+	
+	// ordinary files have no ProDOS file type here, so all of them are searched.
+	//
+	rc = grepOneFile(patterns, thisFile, flags);
+	
+	if (rc < 0) {
+		return progress_stopped() ? Stopped : Error;
+	}
+	
+	return (rc > 0) ? Matched : Unmatched;
+}
+
+/* a file being followed with --follow. */
+typedef struct {
+	char *path;
+	FILE *file;    /* NULL while there is no file of that name */
+	dev_t device;  /* which file is open, so that another given its name is noticed */
+	ino_t inode;
+	SearchState state;
+} FollowedFile;
+
+/* opens a followed file, if there is one of its name, to be searched from its start. */
+static void openFollowed(pattern_set *patterns, FollowedFile *f, int options) {
+	struct stat info;
+	
+	if ((f->file = fopen(f->path, "rb")) == NULL) {
+		return;
+	}
+	
+	if ((fstat(fileno(f->file), &info) != 0) ||
+		(startSearch(&f->state, patterns, f->path, 0, (lineEnding >= 0) ? (char) lineEnding : SLASH_N,
+					 options) < 0)) {
+		fclose(f->file);
+		f->file = NULL;
+		return;
+	}
+	
+	f->device = info.st_dev;
+	f->inode = info.st_ino;
+}
+
+/* finishes with a followed file that has been replaced or cut short, searching the
+   last partial line in it as though the file had ended. */
+static void closeFollowed(FollowedFile *f) {
+	search_finish(f->state.search);
+	endSearch(&f->state);
+	fclose(f->file);
+	f->file = NULL;
+}
+
+/* searches whatever has been added to a followed file since it was last read.  a line
+   still being written is kept by the search until the rest of it turns up. */
+static void readFollowed(FollowedFile *f) {
+	long n;
+	
+	while ((n = (long) fread(block, 1, BLOCK_SIZE, f->file)) > 0) {
+		detectLineEnd(&f->state, n);
+		search_feed(f->state.search, block, n);
+	}
+	
+	if (ferror(f->file)) {
+		perror(f->path);
+	}
+	
+	clearerr(f->file);
+	out_flush();
+}
+
+/* catches up with a followed file that may have changed: been added to, or replaced by
+   a new file (as a log is when it is rotated), or truncated. */
+static void checkFollowed(pattern_set *patterns, FollowedFile *f, int options) {
+	struct stat info;
+	
+	if (f->file != NULL) {
+		// whatever was written to the old file before it was replaced is searched first.
+		//
+		readFollowed(f);
+		
+		if ((stat(f->path, &info) == 0) && ((info.st_dev != f->device) || (info.st_ino != f->inode))) {
+			closeFollowed(f);
+		} else if ((fstat(fileno(f->file), &info) == 0) && (info.st_size < search_offset(f->state.search))) {
+			fprintf(stderr, "%s: file truncated\n", f->path);
+			closeFollowed(f);
+		}
+	}
+	
+	if (f->file == NULL) {
+		openFollowed(patterns, f, options);
+		
+		if (f->file != NULL) {
+			readFollowed(f);
+		}
+	}
+}
+
+/* searches each of the named files and then, rather than stopping at their ends,
+   waits for more to be written to them, searching it as it arrives.  files that
+   don't exist yet are searched once they are created.  only returns on an error. */
+static int followFiles(pattern_set *patterns, char **names, int count, int options) {
+	follow_set *set;
+	FollowedFile *files;
+	unsigned char *changed;
+	struct stat info;
+	int i, followed = 0;
+	
+	set = follow_new();
+	files = (FollowedFile *) malloc(count * sizeof(FollowedFile));
+	changed = (unsigned char *) malloc(count);
+	
+	if ((set == NULL) || (files == NULL) || (changed == NULL)) {
+		perror("--follow");
+		follow_free(set);
+		free(files);
+		free(changed);
+		return -1;
+	}
+	
+	for (i = 0; i < count; i++) {
+		if ((stat(names[i], &info) == 0) && S_ISDIR(info.st_mode)) {
+			fprintf(stderr, "%s: Is a directory\n", names[i]);
+			continue;
+		}
+		
+		if (follow_add(set, names[i]) < 0) {
+			perror(names[i]);
+			continue;
+		}
+		
+		files[followed].path = names[i];
+		openFollowed(patterns, &files[followed], options);
+		
+		if (files[followed].file == NULL) {
+			perror(names[i]);
+		} else {
+			readFollowed(&files[followed]);
+		}
+		
+		followed++;
+	}
+	
+	while ((followed > 0) && !progress_stopped()) {
+		if (follow_wait(set, changed) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			perror("--follow");
+			break;
+		}
+		
+		for (i = 0; i < followed; i++) {
+			if (changed[i]) {
+				checkFollowed(patterns, &files[i], options);
+			}
+		}
+	}
+	
+	for (i = 0; i < followed; i++) {
+		if (files[i].file != NULL) {
+			closeFollowed(&files[i]);
+		}
+	}
+	
+	follow_free(set);
+	free(files);
+	free(changed);
+	
+	return -1;
+}
+
+#endif
+
+/* reads the next path from a list of files into *path, growing it as needed.  returns
+   the length of the path, or -1 at the end of the list. */
+static long readPath(FILE *list, char separator, char **path, size_t *size) {
+	long len = 0;
+	int c;
+	
+	while (((c = getc(list)) != EOF) && (c != separator)) {
+		if (len + 1 >= (long) *size) {
+			char *bigger = (char *) realloc(*path, *size * 2);
+			
+			if (bigger == NULL) {
+				return -1;
+			}
+			
+			*path = bigger;
+			*size *= 2;
+		}
+		
+		(*path)[len++] = (char) c;
+	}
+	
+	(*path)[len] = '\0';
+	
+	return ((c == EOF) && (len == 0)) ? -1 : len;
+}
+
+/* searches each of the files named in the list, one at a time as they are read, so
+   that the list never has to be held in memory (or in argv). */
+static GrepResult grepFilesFrom(pattern_set *patterns, char *listName, char separator, int flags,
+								int *matched, int *errors) {
+	GrepResult grepResult = Unmatched;
+	FILE *list = stdin;
+	size_t size = 256;
+	char *path;
+	
+	if (strcmp(listName, "-") && ((list = fopen(listName, "r")) == NULL)) {
+		perror(listName);
+		*errors = 1;
+		return Error;
+	}
+	
+	if ((path = (char *) malloc(size)) == NULL) {
+		perror(listName);
+		*errors = 1;
+		return Error;
+	}
+	
+	while ((grepResult != Stopped) && (readPath(list, separator, &path, &size) >= 0)) {
+		if (path[0] == '\0') {
+			continue;
+		}
+		
+		grepResult = grepFile(patterns, path, flags);
+		
+		if (grepResult == Matched) {
+			*matched = 1;
+		} else if (grepResult < Matched) {
+			*errors = 1;
+		}
+	}
+	
+	free(path);
+	
+	if (list != stdin) {
+		fclose(list);
+	}
+	
+	return grepResult;
+}
+
+static int listPattern(char *pattern) {
+	char *copy;
+	
+	if (patternListCount == patternListSize) {
+		int size = (patternListSize == 0) ? 16 : patternListSize * 2;
+		char **bigger = (char **) realloc(patternList, size * sizeof(char *));
+		
+		if (bigger == NULL) {
+			return -1;
+		}
+		
+		patternList = bigger;
+		patternListSize = size;
+	}
+	
+	if ((copy = (char *) malloc(strlen(pattern) + 1)) == NULL) {
+		return -1;
+	}
+	
+	strcpy(copy, pattern);
+	patternList[patternListCount++] = copy;
+	return 0;
+}
+
+/* empties the list of patterns, ready for the next query when serving. */
+static void forgetPatterns(void) {
+	while (patternListCount > 0) {
+		free(patternList[--patternListCount]);
+		patternList[patternListCount] = NULL;
+	}
+}
+
+/* adds each line of the file to the list of patterns. */
+static int listPatternFile(char *fileName) {
+	FILE *file = stdin;
+	size_t size = 256;
+	char *line;
+	long len;
+	int rc = 0;
+	
+	if (strcmp(fileName, "-") && ((file = fopen(fileName, "r")) == NULL)) {
+		perror(fileName);
+		return -1;
+	}
+	
+	if ((line = (char *) malloc(size)) == NULL) {
+		rc = -1;
+	}
+	
+	while ((rc == 0) && ((len = readPath(file, '\n', &line, &size)) >= 0)) {
+		// a list written elsewhere may have CR LF line endings.
+		//
+		if ((len > 0) && (line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		
+		if (listPattern(line) != 0) {
+			perror(fileName);
+			rc = -1;
+		}
+	}
+	
+	free(line);
+	
+	if (file != stdin) {
+		fclose(file);
+	}
+	
+	return rc;
+}
+
+/* compiles the listed patterns into a single set, returning NULL (having said why) if
+   one of them won't compile. */
+static pattern_set *compilePatterns(char *name, int flags, int maxErrors) {
+	pattern_set *patterns;
+	int i, rc;
+	
+	if ((patterns = patset_new()) == NULL) {
+		perror(name);
+		return NULL;
+	}
+	
+	patset_set_errors(patterns, maxErrors);
+	patset_set_flags(patterns, (((flags & WordRegexp) != 0) ? RE_WORD : 0) | (((flags & LineRegexp) != 0) ? RE_LINE : 0));
+	
+	for (i = 0; i < patternListCount; i++) {
+		rc = ((flags & FixedStrings) != 0) ? patset_add_fixed(patterns, patternList[i]) :
+			patset_add(patterns, patternList[i]);
+		
+		if (rc == -2) {
+			fprintf(stderr, "%s: only patterns of single characters, with ^ and $ at their ends, can be matched with errors.\n", patternList[i]);
+		} else if (rc < 0) {
+			if ((flags & FixedStrings) != 0) {
+				perror(name);
+			} else {
+				fprintf(stderr, "%s: failed to compile regular expression.\n", patternList[i]);
+			}
+		}
+		
+		if (rc < 0) {
+			patset_free(patterns);
+			return NULL;
+		}
+	}
+	
+	return patterns;
+}
+
+/* writes out, to stderr, the work the regular expression code did on each pattern. */
+static void reportProfile(char *name, pattern_set *patterns) {
+	int i;
+	
+	for (i = 0; (i < patset_count(patterns)) && (i < patternListCount); i++) {
+		fprintf(stderr, "%s: regex profile of %s\n", name, patternList[i]);
+		patset_profile_report(patterns, i, stderr);
+	}
+}
+
+#ifndef AppleIIGS
+
+/* the pattern sets that a server has compiled, kept for later queries. */
+#define PATTERN_CACHE_SIZE 64
+
+/* adds text to a description, after its length, so that no text can run into the
+   next whatever characters it holds. */
+static char *describeText(char *description, char *text) {
+	return description + sprintf(description, "%ld:%s\n", (long) strlen(text), text);
+}
+
+/* describes a search by its options and patterns, returning NULL if there is not
+   enough memory.  The times of its window and the patterns are each given with their
+   length, so that, say, one pattern holding a newline can't be taken for two. */
+static char *describeSearch(int flags, int maxErrors) {
+	char *description, *end;
+	char *window[3];
+	long len = 128;
+	int i;
+	
+	window[0] = (sinceTime != NULL) ? sinceTime : "";
+	window[1] = (untilTime != NULL) ? untilTime : "";
+	window[2] = (timeFormat != NULL) ? timeFormat : "";
+	
+	for (i = 0; i < 3; i++) {
+		len += strlen(window[i]) + 24;
+	}
+	
+	for (i = 0; i < patternListCount; i++) {
+		len += strlen(patternList[i]) + 24;
+	}
+	
+	if ((description = (char *) malloc(len)) == NULL) {
+		return NULL;
+	}
+	
+	end = description + sprintf(description, "%d %d %d %d %ld %d %d\n", flags, maxErrors, lineEnding,
+								outputGroup, maxCount, reverseSearch, patternListCount);
+	
+	for (i = 0; i < 3; i++) {
+		end = describeText(end, window[i]);
+	}
+	
+	for (i = 0; i < patternListCount; i++) {
+		end = describeText(end, patternList[i]);
+	}
+	
+	return description;
+}
+
+/* with --serve, returns the listed patterns as compiled for an earlier query with the
+   same options, or compiles them and keeps them for later ones. */
+static pattern_set *servedPatterns(char *name, int flags, int maxErrors) {
+	pattern_set *patterns;
+	char *key;
+	
+	// only the options that change how the patterns compile are part of the key.
+	//
+	// a set that isn't kept would never be freed, so the query fails instead.
+	//
+	if ((key = describeSearch(flags & (IgnoreCase | FixedStrings | WordRegexp | LineRegexp),
+							  maxErrors)) == NULL) {
+		perror(name);
+		return NULL;
+	}
+	
+	if (((patterns = (pattern_set *) cache_get(patternCache, key, 0)) == NULL) &&
+		((patterns = compilePatterns(name, flags, maxErrors)) != NULL) &&
+		(cache_put(patternCache, key, 0, patterns, 1) < 0)) {
+		perror(name);
+		patset_free(patterns);
+		patterns = NULL;
+	}
+	
+	free(key);
+	return patterns;
+}
+
+#endif
+
+/* with --progress, adds up the sizes of the count files named, along with any more that
+   are to be searched, as far as they can be known. */
+static void expectFiles(char **names, int count, int more) {
+	#ifndef AppleIIGS
+	struct stat info;
+	int i;
+	
+	for (i = 0; i < count; i++) {
+		if ((stat(names[i], &info) == 0) && S_ISREG(info.st_mode)) {
+			progress_expect((long) info.st_size);
+		} else {
+			progress_expect(-1);
+		}
+	}
+	
+	// the standard input, the files of a directory and those listed in a file can't be
+	// known until they are searched.
+	//
+	if ((count == 0) || more) {
+		progress_expect(-1);
+	}
+	#else
+	progress_expect(-1);
+	#endif
+}
+
+/* runs grep with the given arguments, returning its exit status. */
+static int grepMain(int argc, char *argv[]) {
+	int matched = 0, errors = 0;
+	int i, opt, rc, flags = ShowFilename, maxErrors = 0, follow = 0;
+	struct parg_state ps;
+	int optend, progressOptions = PROGRESS_CANCEL, slowest = -1, profileRegex = 0;
+	pattern_set *patterns;
+	char *filesFrom = NULL, *cacheDir = NULL;
+	char pathSeparator = '\n';
+	GrepResult grepResult = Unmatched;
+	
+	// a server runs one query after another, so nothing is left from the last.
+	//
+	lineEnding = NativeLineEnd;
+	outputGroup = 0;
+	timewin_free(timeWindow);
+	timeWindow = NULL;
+	sinceTime = untilTime = timeFormat = NULL;
+	maxCount = -1;
+	reverseSearch = 0;
+	backtrackLimit = DEFAULT_BACKTRACK_LIMIT;
+	forgetPatterns();
+	
+	parg_init(&ps);
+	
+	// reorder the arguments for parg, so that options are first.
+	//
+	if ((optend = parg_reorder(argc, argv, "acinHhRozFwxm:e:f:", longOptions)) < 0) {
+		perror(argv[0]);
+		return 2;
+	}
+	
+	// parse the options and arguments.
+	//
+	while ((errors == 0) &&
+		   (opt = parg_getopt_long(&ps, optend, argv, "acinHhRozFwxm:e:f:", longOptions, NULL)) != -1) {
+		switch(opt) {
+		case 'a': flags |= AllFiles;  	  
+			break;
+			
+		case 'i': flags |= IgnoreCase;  	  
+			break;
+			
+		case 'n': flags |= ShowLineNumbers;
+			break;
+			
+		case 'H': flags |= ShowFilename;
+			break;
+			
+		case 'h': flags &= (~ShowFilename);
+			break;
+			
+		case 'R': flags |= Recursive;
+			break;
+			
+		case 'o': flags |= OnlyMatching;
+			break;
+			
+		case 'c': flags |= CountOnly;
+			break;
+			
+		case 'F': flags |= FixedStrings;
+			break;
+			
+		case 'w': flags |= WordRegexp;
+			break;
+			
+		case 'x': flags |= LineRegexp;
+			break;
+			
+		case 'm': {
+			char *end;
+			
+			maxCount = strtol(ps.optarg, &end, 10);
+			
+			if ((end == ps.optarg) || (*end != '\0') || (maxCount < 0)) {
+				fprintf(stderr, "%s: -m must be a number of lines\n", argv[0]);
+				return 2;
+			}
+			break;
+		}
+			
+		case ReverseOption: reverseSearch = 1;
+			break;
+			
+		case ProgressOption: progressOptions |= PROGRESS_REPORT;
+			break;
+			
+		case StatsOption: {
+			char *end;
+			long value = (ps.optarg != NULL) ? strtol(ps.optarg, &end, 10) : 5;
+			
+			if ((ps.optarg != NULL) && ((end == ps.optarg) || (*end != '\0') || (value < 0) || (value > 100))) {
+				fprintf(stderr, "%s: --stats must list from 0 to 100 of the slowest files\n", argv[0]);
+				return 2;
+			}
+			
+			slowest = (int) value;
+			break;
+		}
+			
+		case ProfileRegexOption: profileRegex = 1;
+			break;
+			
+		case BacktrackLimitOption: {
+			char *end;
+			
+			backtrackLimit = strtol(ps.optarg, &end, 10);
+			
+			if ((end == ps.optarg) || (*end != '\0') || (backtrackLimit < 0)) {
+				fprintf(stderr, "%s: --backtrack-limit must be a number of steps\n", argv[0]);
+				return 2;
+			}
+			break;
+		}
+			
+		case JsonOption: flags |= JsonOutput;
+			break;
+			
+		case 'z': lineEnding = 0;
+			break;
+			
+		case LineEndingOption:
+			if (!strcmp(ps.optarg, "lf")) {
+				lineEnding = '\012';
+			} else if (!strcmp(ps.optarg, "cr")) {
+				lineEnding = '\015';
+			} else if (!strcmp(ps.optarg, "nul")) {
+				lineEnding = 0;
+			} else if (!strcmp(ps.optarg, "auto")) {
+				lineEnding = AutoLineEnd;
+			} else {
+				errors = 1;
+			}
+			break;
+			
+		case FilesFromOption: filesFrom = (char *) ps.optarg;
+			break;
+			
+		case NullOption: pathSeparator = '\0';
+			break;
+			
+		case 'e':
+			if (listPattern((char *) ps.optarg) != 0) {
+				perror(argv[0]);
+				return 2;
+			}
+			break;
+			
+		case 'f':
+			if (listPatternFile((char *) ps.optarg) != 0) {
+				return 2;
+			}
+			break;
+			
+		case PatternIdsOption: flags |= PatternIds;
+			break;
+			
+		case PatternCountsOption: flags |= PatternCounts;
+			break;
+			
+		case MaxErrorsOption: {
+			char *end;
+			long value = strtol(ps.optarg, &end, 10);
+			
+			if ((end == ps.optarg) || (*end != '\0') || (value < 0) || (value > RE_MAX_ERRORS)) {
+				fprintf(stderr, "%s: --max-errors must be from 0 to %d\n", argv[0], RE_MAX_ERRORS);
+				return 2;
+			}
+			
+			maxErrors = (int) value;
+			break;
+		}
+			
+		case GroupOption: {
+			char *end;
+			long value = strtol(ps.optarg, &end, 10);
+			
+			if ((end == ps.optarg) || (*end != '\0') || (value < 0) || (value > NFA_MAX_GROUPS)) {
+				fprintf(stderr, "%s: --group must be from 0 to %d\n", argv[0], NFA_MAX_GROUPS);
+				return 2;
+			}
+			
+			outputGroup = (int) value;
+			break;
+		}
+			
+		case FollowOption:
+			#ifdef AppleIIGS
+			fprintf(stderr, "%s: --follow is not supported on the IIGS\n", argv[0]);
+			return 2;
+			#else
+			follow = 1;
+			break;
+			#endif
+			
+		case CacheDirOption:
+			#ifdef AppleIIGS
+			fprintf(stderr, "%s: --cache-dir is not supported on the IIGS\n", argv[0]);
+			return 2;
+			#else
+			cacheDir = (char *) ps.optarg;
+			break;
+			#endif
+			
+		case SinceOption: sinceTime = (char *) ps.optarg;
+			break;
+			
+		case UntilOption: untilTime = (char *) ps.optarg;
+			break;
+			
+		case TimeFormatOption: timeFormat = (char *) ps.optarg;
+			break;
+			
+		case ColorOption:
+			if ((ps.optarg == NULL) || !strcmp(ps.optarg, "always")) {
+				flags |= Color;
+			} else if (!strcmp(ps.optarg, "never")) {
+				flags &= (~Color);
+			} else if (!strcmp(ps.optarg, "auto")) {
+				#ifdef AppleIIGS
+				flags &= (~Color);
+				#else
+				if (isatty(fileno(stdout))) {
+					flags |= Color;
+				} else {
+					flags &= (~Color);
+				}
+				#endif
+			} else {
+				errors = 1;
+			}
+			break;
+			
+		case 1:
+			break;
+			
+		case '?':
+			/*if (ps.optopt == 'o') {
+			printf("option -o requires an argument\n");
+			} else {*/
+			errors = 1;
+			//}
+			break;
+			
+		default: 
+			errors = 1;
+		}
+	}
+	
+	i = ps.optind;
+	
+	// without -e or -f, the first argument is the pattern.
+	//
+	if ((errors == 0) && (patternListCount == 0) && (i < argc) && (listPattern(argv[i++]) != 0)) {
+		perror(argv[0]);
+		return 2;
+	}
+	
+	// files being followed never come to an end, so there are never totals for them.
+	//
+	if (follow && (((flags & (CountOnly | PatternCounts)) != 0) || (filesFrom != NULL))) {
+		fprintf(stderr, "%s: --follow can't be used with -c, --pattern-counts or --files-from\n", argv[0]);
+		return 2;
+	}
+	
+	// the totals for --pattern-counts come from searching every file, which a cached
+	// file isn't.
+	//
+	if ((cacheDir != NULL) && (follow || ((flags & PatternCounts) != 0))) {
+		fprintf(stderr, "%s: --cache-dir can't be used with --follow or --pattern-counts\n", argv[0]);
+		return 2;
+	}
+	
+	// line numbers and offsets count from the start of the file, which isn't read.
+	//
+	if (((sinceTime != NULL) || (untilTime != NULL)) &&
+		(follow || ((flags & (ShowLineNumbers | JsonOutput)) != 0))) {
+		fprintf(stderr, "%s: --since and --until can't be used with -n, --json or --follow\n", argv[0]);
+		return 2;
+	}
+	
+	if (reverseSearch && (follow || ((flags & (ShowLineNumbers | JsonOutput)) != 0))) {
+		fprintf(stderr, "%s: --reverse can't be used with -n, --json or --follow\n", argv[0]);
+		return 2;
+	}
+	
+	if ((errors != 0) || (patternListCount == 0)) {
+		fprintf(stderr, "usage: %s [-acinHhRozFwx] [-m NUM] [--color[=WHEN]] [--json] [--line-ending=lf|cr|nul|auto] [--files-from=FILE [--null]] [--pattern-ids] [--pattern-counts] [--max-errors=K] [--group=N] [--follow] [--cache-dir=DIR] [--since=TIME] [--until=TIME] [--time-format=FORMAT] [--reverse] [--progress] [--stats[=N]] [--profile-regex] [--backtrack-limit=N] (regex | -e regex ... | -f FILE) [files...]\n", argv[0]);
+		return 2;
+	}
+	
+	// with -m 0, no lines at all are wanted, so nothing need be read.
+	//
+	if (maxCount == 0) {
+		return 1;
+	}
+	
+	// compile the regular expressions into a single set, to be matched together (with
+	// -F they are taken as plain text instead).  if we are ignoring case, then set the
+	// patterns to be all lower case.  the same will be done as we read the file(s).
+	//
+	if ((flags & IgnoreCase) != 0) {
+		for (opt = 0; opt < patternListCount; opt++) {
+			toLower(patternList[opt], (flags & FixedStrings) == 0);
+		}
+	}
+	
+	#ifndef AppleIIGS
+	if (patternCache != NULL) {
+		patterns = servedPatterns(argv[0], flags, maxErrors);
+	} else
+	#endif
+	patterns = compilePatterns(argv[0], flags, maxErrors);
+	
+	if (patterns == NULL) {
+		return 2;
+	}
+	
+	// a served set starts each query backtracking again, under that query's limit.
+	//
+	patset_set_budget(patterns, backtrackLimit);
+	fallbacksWarned = 0;
+	
+	if (((sinceTime != NULL) || (untilTime != NULL)) &&
+		((timeWindow = timewin_new((timeFormat != NULL) ? timeFormat : TIMEWIN_DEFAULT_FORMAT,
+								   sinceTime, untilTime)) == NULL)) {
+		fprintf(stderr, "%s: --since and --until must be times in the form %s\n", argv[0],
+				(timeFormat != NULL) ? timeFormat : TIMEWIN_DEFAULT_FORMAT);
+		return 2;
+	}
+	
+	#ifndef AppleIIGS
+	// an interrupt stops a server, not just the query it is running.
+	//
+	if (patternCache != NULL) {
+		progressOptions &= (~PROGRESS_CANCEL);
+	}
+	#endif
+	
+	progress_start(progressOptions);
+	
+	if ((slowest >= 0) && (stats_start(slowest) < 0)) {
+		perror(argv[0]);
+	}
+	
+	if (profileRegex && (patset_profile_start(patterns) < 0)) {
+		perror(argv[0]);
+		profileRegex = 0;
+	}
+	
+	if ((progressOptions & PROGRESS_REPORT) != 0) {
+		expectFiles(&argv[i], argc - i, filesFrom != NULL);
+	}
+	
+	#ifndef AppleIIGS
+	if (follow && (i < argc)) {
+		followFiles(patterns, &argv[i], argc - i, flags);
+		progress_finish();
+		stats_report(argv[0]);
+		
+		if (profileRegex) {
+			reportProfile(argv[0], patterns);
+		}
+		
+		return 2;
+	}
+	
+	if (cacheDir != NULL) {
+		char *description = describeSearch(flags, maxErrors);
+		
+		if ((description == NULL) || ((resultCache = results_open(cacheDir, description)) == NULL)) {
+			perror(cacheDir);
+		}
+		
+		free(description);
+	}
+	#endif
+	
+	if ((i < argc) || (filesFrom != NULL)) {
+		for (; (grepResult != Stopped) && (i < argc); i++) {
+			grepResult = grepFile(patterns, argv[i], flags);
+			
 			if (grepResult == Matched) {
 				matched = 1;
+			} else if (grepResult < Matched) {
+				errors = 1;
 			}
-		} while ((grepResult >= Matched) && (++i < argc));
+		}
 		
-		if (grepResult < Matched) {
-			errors = 1;
+		if ((grepResult != Stopped) && (filesFrom != NULL)) {
+			grepFilesFrom(patterns, filesFrom, pathSeparator, flags, &matched, &errors);
 		}
 	} else {
-		int rc = grep(regex, NULL, flags);
+		rc = grep(patterns, NULL, NO_FILE_TYPE, 0, flags);
 		
-		if (rc >= 0) {
+		if (rc > 0) {
 			matched = 1;
 		} else if (rc < 0) {
 			errors = 1;
 		}
 	}
 	
+	progress_finish();
+	stats_report(argv[0]);
+	
+	if (profileRegex) {
+		reportProfile(argv[0], patterns);
+	}
+	
+	timewin_free(timeWindow);
+	timeWindow = NULL;
+	
+	#ifndef AppleIIGS
+	if (resultCache != NULL) {
+		fprintf(stderr, "%s: result cache: %ld hits, %ld misses\n", argv[0],
+				results_hits(resultCache), results_misses(resultCache));
+		results_close(resultCache);
+		resultCache = NULL;
+	}
+	#endif
+	
 	return errors ? 2 : !matched;
 }
+
+#ifndef AppleIIGS
+
+/* runs a query sent to a server by a client. */
+static int runServedQuery(int argc, char **argv) {
+	int status = grepMain(argc, argv);
+	
+	out_flush();
+	return status;
+}
+
+/* with --serve, answers queries from clients until the server is stopped, keeping
+   compiled patterns, file contents and directory listings between them. */
+static int serveQueries(char *socketPath) {
+	patternCache = cache_new(PATTERN_CACHE_SIZE, releasePatterns);
+	fileCache = cache_new(FILE_CACHE_SIZE, free);
+	directoryCache = cache_new(DIRECTORY_CACHE_SIZE, free);
+	
+	if ((patternCache == NULL) || (fileCache == NULL) || (directoryCache == NULL)) {
+		perror("--serve");
+		return 2;
+	}
+	
+	serve_listen(socketPath, runServedQuery);
+	perror(socketPath);
+	
+	return 2;
+}
+
+#endif
+
+int main(int argc, char *argv[]) {
+	#ifndef AppleIIGS
+	char *socketPath;
+	int rc;
+	
+	// --serve and --connect choose how grep runs rather than what it does, so they have
+	// to come first.
+	//
+	if ((argc > 1) && !strncmp(argv[1], "--serve=", 8)) {
+		return serveQueries(&argv[1][8]);
+	}
+	
+	if ((argc > 1) && !strncmp(argv[1], "--connect=", 10)) {
+		// the server is sent the rest of the arguments, as though run with them.
+		//
+		socketPath = &argv[1][10];
+		argv[1] = argv[0];
+		
+		if ((rc = serve_query(socketPath, argc - 1, &argv[1])) < 0) {
+			perror(socketPath);
+			return 2;
+		}
+		
+		return rc;
+	}
+	#endif
+	
+	return grepMain(argc, argv);
+}
@@ -0,0 +1,1235 @@
+/*
+ * Regular expressions with alternation, grouping and bounded repetition.
+ *
+ * A pattern is parsed by recursive descent into a tree of nodes, which is then written
+ * out as a program of the instructions below.  The Pike VM runs the program over the
+ * text with a list of threads for each position, taking the threads in order of
+ * preference; a thread that reaches an instruction already taken at that position is
+ * dropped, so there are never more threads than instructions.  Every thread carries
+ * the places its groups started and ended, the whole match being group 0.
+ *
+ * Finding a match only needs group 0, so the groups themselves are found afterwards,
+ * from where the match starts.  A pattern that is one-pass, where at each point at most
+ * one way on can take the next character, is run as a deterministic automaton whose
+ * steps record the groups as they go, with a single state followed along the text.
+ * Any other pattern is run through the Pike VM again with all its groups.
+ */
+
+#include "nfa.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+#define MAX_PROGRAM            1000  /* instructions in a program            */
+#define MAX_REPEAT             255   /* the largest count in {n,m}            */
+#define MAX_NESTING            16    /* groups within groups                  */
+#define MAX_LITERAL            32
+
+#define NO_LIMIT               -1
+#define NO_NODE                -1
+
+/* the condition on a step of a one-pass automaton that an assertion holds */
+#define CONDITION(op)          (1 << ((op) - OP_BOL))
+
+/* the instructions from OP_BOL to OP_WORD_END are assertions, which read nothing */
+enum { OP_CHAR, OP_ANY, OP_CLASS, OP_BOL, OP_EOL, OP_BOUNDARY, OP_NOT_BOUNDARY, OP_WORD_START, OP_WORD_END,
+	   OP_SPLIT, OP_JMP, OP_SAVE, OP_MATCH };
+enum { N_EMPTY, N_CHAR, N_ANY, N_CLASS, N_ASSERT, N_CAT, N_ALT, N_REPEAT, N_GROUP };
+
+typedef struct {
+	unsigned char  op;
+	int            x;        /* the character, class, save slot, or preferred branch */
+	int            y;        /* the other branch of a split                          */
+} instruction;
+
+typedef unsigned char charclass[32];   /* a bit for each character */
+
+typedef struct node {
+	int            type;
+	int            value;    /* the character, class or group                      */
+	int            min;      /* the counts of a repeat                             */
+	int            max;
+	int            greedy;
+	struct node*   child;    /* the operands of a sequence or alternation, or the  */
+	struct node*   next;     /*   operand of a repeat or group, linked by next     */
+} node;
+
+typedef struct {
+	const char*    p;
+	node*          pool;
+	int            used;
+	int            size;
+	int            groups;
+	int            depth;
+	int            error;
+	charclass*     classes;
+	int            nclasses;
+} parser;
+
+/* A step out of a state of the one-pass automaton: the instruction that reads the next
+   character (or none, for a match), the state it leads to, and the slots saved on the
+   way.  The steps of a state are kept in order of preference. */
+typedef struct {
+	int            pc;          /* -1 for a match                              */
+	int            target;
+	int            conditions;
+	int            firstSave;
+	int            saveCount;
+} step;
+
+typedef struct {
+	long           generation;  /* marks the instructions taken into this list */
+	int            count;
+	int*           pcs;
+	int*           caps;        /* nsave slots for each thread                 */
+} threadlist;
+
+struct nfa_prog {
+	instruction*   code;
+	int            length;
+	int            nsave;       /* two for each group, and two for the whole match */
+	charclass*     classes;
+	char           literal[MAX_LITERAL];
+	int            literalLength;
+	int            lastStart;   /* where the last match found started          */
+	
+	/* the one-pass automaton, if the pattern is one-pass and has groups */
+	step*          steps;
+	int*           firstStep;   /* the steps of each state, and one past the last */
+	int*           saves;
+	
+	/* work space for running the program */
+	threadlist     lists[2];
+	long           generation;
+	long*          onList;      /* the list each instruction was last taken into   */
+	int*           stack;
+	int*           working;     /* the slots of the thread being followed          */
+	int*           matched;     /* the slots of the match found                    */
+};
+
+
+
+/* Private functions: */
+static node* parseAlternation(parser* ps);
+
+static node* newNode(parser* ps, int type) {
+	node* n;
+	
+	if (ps->used == ps->size) {
+		ps->error = 1;
+		return NULL;
+	}
+	
+	n = &ps->pool[ps->used++];
+	n->type = type;
+	n->value = 0;
+	n->min = n->max = 1;
+	n->greedy = 1;
+	n->child = n->next = NULL;
+	
+	return n;
+}
+
+static int isWordChar(int c) {
+	return isalnum(c) || (c == '_');
+}
+
+static void addToClass(charclass cls, int c) {
+	cls[c >> 3] |= (unsigned char) (1 << (c & 7));
+}
+
+/* Add the characters of \d, \w or \s (or their opposites) to cls, returning 0 if c
+   is not one of those. */
+static int addEscapeClass(charclass cls, int c) {
+	int i, in;
+	
+	if (strchr("dDwWsS", c) == NULL) {
+		return 0;
+	}
+	
+	for (i = 1; i < 256; i++) {
+		switch (tolower(c)) {
+		case 'd': in = isdigit(i); break;
+		case 'w': in = isWordChar(i); break;
+		default:  in = isspace(i); break;
+		}
+		
+		if ((in != 0) == (islower(c) != 0)) {
+			addToClass(cls, i);
+		}
+	}
+	
+	return 1;
+}
+
+static node* newClass(parser* ps) {
+	node* n;
+	
+	if ((n = newNode(ps, N_CLASS)) != NULL) {
+		n->value = ps->nclasses++;
+		memset(ps->classes[n->value], 0, sizeof(charclass));
+	}
+	
+	return n;
+}
+
+static node* newAssertion(parser* ps, int op) {
+	node* n;
+	
+	if ((n = newNode(ps, N_ASSERT)) != NULL) {
+		n->value = op;
+	}
+	
+	return n;
+}
+
+/* Parse a bracket expression, the '[' having been read. */
+static node* parseBrackets(parser* ps) {
+	node* n;
+	unsigned char* cls;
+	int negate = 0, first = 1, c, last, i;
+	
+	if ((n = newClass(ps)) == NULL) {
+		return NULL;
+	}
+	
+	cls = ps->classes[n->value];
+	
+	if (*ps->p == '^') {
+		negate = 1;
+		ps->p++;
+	}
+	
+	/* a ']' straight after the '[' is taken as itself */
+	while ((*ps->p != ']') || first) {
+		first = 0;
+		
+		if ((c = (unsigned char) *ps->p++) == '\0') {
+			ps->error = 1;
+			return NULL;
+		}
+		
+		if (c == '\\') {
+			if ((c = (unsigned char) *ps->p++) == '\0') {
+				ps->error = 1;
+				return NULL;
+			}
+			
+			if (addEscapeClass(cls, c)) {
+				continue;
+			}
+		}
+		
+		if ((ps->p[0] == '-') && (ps->p[1] != ']') && (ps->p[1] != '\0')) {
+			if ((last = (unsigned char) ps->p[1]) == '\\') {
+				if ((last = (unsigned char) ps->p[2]) == '\0') {
+					ps->error = 1;
+					return NULL;
+				}
+				ps->p++;
+			}
+			
+			ps->p += 2;
+			
+			for (i = c; i <= last; i++) {
+				addToClass(cls, i);
+			}
+		} else {
+			addToClass(cls, c);
+		}
+	}
+	
+	ps->p++;
+	
+	if (negate) {
+		for (i = 0; i < (int) sizeof(charclass); i++) {
+			cls[i] = (unsigned char) ~cls[i];
+		}
+	}
+	
+	/* the text ends at a nul, so nothing matches one */
+	cls[0] &= (unsigned char) ~1;
+	
+	return n;
+}
+
+static node* parseAtom(parser* ps) {
+	node* n;
+	int c = (unsigned char) *ps->p++;
+	
+	switch (c) {
+	case '(':
+		if (++ps->depth > MAX_NESTING) {
+			ps->error = 1;
+			return NULL;
+		}
+		
+		if ((n = newNode(ps, N_GROUP)) == NULL) {
+			return NULL;
+		}
+		
+		/* groups are numbered by their opening parentheses, from 1 */
+		n->value = ++ps->groups;
+		
+		if ((n->value > NFA_MAX_GROUPS) || ((n->child = parseAlternation(ps)) == NULL) || (*ps->p != ')')) {
+			ps->error = 1;
+			return NULL;
+		}
+		
+		ps->p++;
+		ps->depth--;
+		return n;
+	
+	case '.':
+		return newNode(ps, N_ANY);
+	
+	case '^':
+		return newAssertion(ps, OP_BOL);
+	
+	case '$':
+		return newAssertion(ps, OP_EOL);
+	
+	case '[':
+		return parseBrackets(ps);
+	
+	case '\\':
+		if ((c = (unsigned char) *ps->p++) == '\0') {
+			ps->error = 1;
+			return NULL;
+		}
+		
+		if (strchr("dDwWsS", c) != NULL) {
+			if ((n = newClass(ps)) != NULL) {
+				addEscapeClass(ps->classes[n->value], c);
+			}
+			return n;
+		} else if ((c == 'b') || (c == 'B')) {
+			return newAssertion(ps, (c == 'b') ? OP_BOUNDARY : OP_NOT_BOUNDARY);
+		}
+		break;
+	
+	case '*': case '+': case '?': case ')': case '|':
+		/* a repeat of nothing, or a ')' with no '(' */
+		ps->error = 1;
+		return NULL;
+	}
+	
+	if ((n = newNode(ps, N_CHAR)) != NULL) {
+		n->value = c;
+	}
+	
+	return n;
+}
+
+/* Read a count of a bound, returning -1 if there are no digits. */
+static int parseCount(parser* ps) {
+	int count = 0, digits = 0;
+	
+	while (isdigit((unsigned char) *ps->p)) {
+		if (count <= MAX_REPEAT) {
+			count = count * 10 + (*ps->p - '0');
+		}
+		ps->p++;
+		digits++;
+	}
+	
+	return (digits > 0) ? count : -1;
+}
+
+/* Parse a bound of the form {n}, {n,} or {n,m}, the '{' having been read.  Returns 0
+   (leaving the '{' to be taken as itself) if it isn't one. */
+static int parseBound(parser* ps, int* min, int* max) {
+	const char* start = ps->p;
+	
+	if ((*min = parseCount(ps)) < 0) {
+		ps->p = start;
+		return 0;
+	}
+	
+	*max = *min;
+	
+	if (*ps->p == ',') {
+		ps->p++;
+		*max = parseCount(ps);
+	}
+	
+	if (*ps->p != '}') {
+		ps->p = start;
+		return 0;
+	}
+	
+	ps->p++;
+	
+	if ((*min > MAX_REPEAT) || (*max > MAX_REPEAT) || ((*max >= 0) && (*max < *min))) {
+		ps->error = 1;
+	}
+	
+	return 1;
+}
+
+static node* parseRepeat(parser* ps) {
+	node *n, *repeat;
+	const char* before;
+	int min, max;
+	
+	if ((n = parseAtom(ps)) == NULL) {
+		return NULL;
+	}
+	
+	for (;;) {
+		before = ps->p;
+		
+		if (*ps->p == '*') {
+			min = 0;
+			max = NO_LIMIT;
+		} else if (*ps->p == '+') {
+			min = 1;
+			max = NO_LIMIT;
+		} else if (*ps->p == '?') {
+			min = 0;
+			max = 1;
+		} else if (*ps->p == '{') {
+			ps->p++;
+			
+			if (!parseBound(ps, &min, &max)) {
+				ps->p = before;
+				return n;
+			}
+			
+			if (ps->error) {
+				return NULL;
+			}
+			
+			ps->p--;
+		} else {
+			return n;
+		}
+		
+		ps->p++;
+		
+		if ((repeat = newNode(ps, N_REPEAT)) == NULL) {
+			return NULL;
+		}
+		
+		repeat->min = min;
+		repeat->max = max;
+		/* as in re.c, '?' would rather match nothing */
+		repeat->greedy = (*before != '?');
+		repeat->child = n;
+		n = repeat;
+	}
+}
+
+/* Parse a sequence, up to a '|' or ')' or the end. */
+static node* parseSequence(parser* ps) {
+	node *seq, *n, *last = NULL;
+	
+	if ((seq = newNode(ps, N_CAT)) == NULL) {
+		return NULL;
+	}
+	
+	while ((*ps->p != '\0') && (*ps->p != '|') && (*ps->p != ')')) {
+		if ((n = parseRepeat(ps)) == NULL) {
+			return NULL;
+		}
+		
+		if (last == NULL) {
+			seq->child = n;
+		} else {
+			last->next = n;
+		}
+		last = n;
+	}
+	
+	if (seq->child == NULL) {
+		seq->type = N_EMPTY;
+	} else if (seq->child->next == NULL) {
+		return seq->child;
+	}
+	
+	return seq;
+}
+
+static node* parseAlternation(parser* ps) {
+	node *alt, *n;
+	
+	if ((n = parseSequence(ps)) == NULL) {
+		return NULL;
+	}
+	
+	if (*ps->p != '|') {
+		return n;
+	}
+	
+	if ((alt = newNode(ps, N_ALT)) == NULL) {
+		return NULL;
+	}
+	
+	alt->child = n;
+	
+	while (*ps->p == '|') {
+		ps->p++;
+		
+		if ((n->next = parseSequence(ps)) == NULL) {
+			return NULL;
+		}
+		n = n->next;
+	}
+	
+	return alt;
+}
+
+/* Returns the number of instructions n will be written out as, or more than
+   MAX_PROGRAM if that is too many. */
+static long programSize(node* n) {
+	long size = 0, each;
+	node* c;
+	
+	switch (n->type) {
+	case N_EMPTY:
+		return 0;
+	
+	case N_GROUP:
+		return 2 + programSize(n->child);
+	
+	case N_CAT:
+	case N_ALT:
+		for (c = n->child; (c != NULL) && (size <= MAX_PROGRAM); c = c->next) {
+			size += programSize(c) + ((n->type == N_ALT) && (c->next != NULL) ? 2 : 0);
+		}
+		return size;
+	
+	case N_REPEAT:
+		if ((each = programSize(n->child)) > MAX_PROGRAM) {
+			return each;
+		}
+		return n->min * each + ((n->max == NO_LIMIT) ? each + 2 : (n->max - n->min) * (each + 1));
+	
+	default:
+		return 1;
+	}
+}
+
+static int emit(nfa_prog* prog, int op, int x, int y) {
+	instruction* in = &prog->code[prog->length];
+	
+	in->op = (unsigned char) op;
+	in->x = x;
+	in->y = y;
+	
+	return prog->length++;
+}
+
+/* Point a split to body and out, with body first if it is greedy. */
+static void setSplit(nfa_prog* prog, int split, int body, int out, int greedy) {
+	prog->code[split].x = greedy ? body : out;
+	prog->code[split].y = greedy ? out : body;
+}
+
+static void emitNode(nfa_prog* prog, node* n) {
+	node* c;
+	int i, split, holes = -1, next;
+	
+	switch (n->type) {
+	case N_EMPTY:
+		break;
+	
+	case N_CHAR:  emit(prog, OP_CHAR, n->value, 0);  break;
+	case N_ANY:   emit(prog, OP_ANY, 0, 0);          break;
+	case N_CLASS: emit(prog, OP_CLASS, n->value, 0); break;
+	case N_ASSERT: emit(prog, n->value, 0, 0);       break;
+	
+	case N_GROUP:
+		emit(prog, OP_SAVE, 2 * n->value, 0);
+		emitNode(prog, n->child);
+		emit(prog, OP_SAVE, 2 * n->value + 1, 0);
+		break;
+	
+	case N_CAT:
+		for (c = n->child; c != NULL; c = c->next) {
+			emitNode(prog, c);
+		}
+		break;
+	
+	case N_ALT:
+		/* each alternative but the last is tried first, and jumps past the rest; the
+		   jumps are chained through x until the end is known */
+		for (c = n->child; c != NULL; c = c->next) {
+			if (c->next == NULL) {
+				emitNode(prog, c);
+				break;
+			}
+			
+			split = emit(prog, OP_SPLIT, 0, 0);
+			emitNode(prog, c);
+			holes = emit(prog, OP_JMP, holes, 0);
+			setSplit(prog, split, split + 1, prog->length, 1);
+		}
+		
+		for (i = holes; i >= 0; i = next) {
+			next = prog->code[i].x;
+			prog->code[i].x = prog->length;
+		}
+		break;
+	
+	case N_REPEAT:
+		for (i = 0; i < n->min; i++) {
+			emitNode(prog, n->child);
+		}
+		
+		if (n->max == NO_LIMIT) {
+			split = emit(prog, OP_SPLIT, 0, 0);
+			emitNode(prog, n->child);
+			emit(prog, OP_JMP, split, 0);
+			setSplit(prog, split, split + 1, prog->length, n->greedy);
+			break;
+		}
+		
+		/* each optional copy may be skipped along with all those after it; the splits
+		   are chained through y until the end is known */
+		for (; i < n->max; i++) {
+			split = emit(prog, OP_SPLIT, 0, holes);
+			holes = split;
+			emitNode(prog, n->child);
+		}
+		
+		for (i = holes; i >= 0; i = next) {
+			next = prog->code[i].y;
+			setSplit(prog, i, i + 1, prog->length, n->greedy);
+		}
+		break;
+	}
+}
+
+/* Find the longest run of characters that the top level of the pattern requires. */
+static void findLiteral(nfa_prog* prog, node* root) {
+	node *n, *start = NULL, *best = NULL;
+	int run = 0, i;
+	
+	prog->literalLength = 0;
+	
+	for (n = (root->type == N_CAT) ? root->child : root; n != NULL; n = (n == root) ? NULL : n->next) {
+		if (n->type != N_CHAR) {
+			run = 0;
+			continue;
+		}
+		
+		if (run++ == 0) {
+			start = n;
+		}
+		
+		if (run > prog->literalLength) {
+			prog->literalLength = run;
+			best = start;
+		}
+	}
+	
+	if (prog->literalLength > MAX_LITERAL) {
+		prog->literalLength = MAX_LITERAL;
+	}
+	
+	for (i = 0; i < prog->literalLength; i++, best = best->next) {
+		prog->literal[i] = (char) best->value;
+	}
+}
+
+/* Returns non-zero if the instruction at pc reads c. */
+static int accepts(nfa_prog* prog, int pc, unsigned char c) {
+	instruction* in = &prog->code[pc];
+	
+	switch (in->op) {
+	case OP_CHAR:  return (c == in->x);
+	case OP_ANY:   return (c != '\0') && (c != '\n') && (c != '\r');
+	case OP_CLASS: return (prog->classes[in->x][c >> 3] & (1 << (c & 7))) != 0;
+	default:       return 0;
+	}
+}
+
+/* Returns non-zero if the assertion op holds at position sp of text. */
+static int holds(int op, const char* text, int sp) {
+	int before = (sp > 0) && isWordChar((unsigned char) text[sp - 1]);
+	int after = isWordChar((unsigned char) text[sp]);
+	
+	switch (op) {
+	case OP_BOL:          return (sp == 0);
+	case OP_EOL:          return (text[sp] == '\0');
+	case OP_BOUNDARY:     return (before != after);
+	case OP_NOT_BOUNDARY: return (before == after);
+	case OP_WORD_START:   return !before;
+	default:              return !after;
+	}
+}
+
+/* Returns non-zero if every assertion in conditions (made with CONDITION) holds at
+   position sp of text. */
+static int conditionsHold(int conditions, const char* text, int sp) {
+	int op;
+	
+	for (op = OP_BOL; op <= OP_WORD_END; op++) {
+		if (((conditions & CONDITION(op)) != 0) && !holds(op, text, sp)) {
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/* Take pc into list, following the instructions that don't read a character (with
+   working holding the slots of the thread), at position sp of text, and keeping the
+   first width slots.  The stack holds the instructions still to follow, and the slots
+   to put back once they have been. */
+static void addThread(nfa_prog* prog, threadlist* list, int pc, const char* text, int sp, int width) {
+	int* stack = prog->stack;
+	int* working = prog->working;
+	int top = 0, slot, value;
+	instruction* in;
+	
+	stack[top++] = pc;
+	stack[top++] = -1;
+	stack[top++] = 0;
+	
+	while (top > 0) {
+		value = stack[--top];
+		slot = stack[--top];
+		pc = stack[--top];
+		
+		if (slot >= 0) {
+			working[slot] = value;
+			continue;
+		}
+		
+		if (prog->onList[pc] == list->generation) {
+			continue;
+		}
+		
+		prog->onList[pc] = list->generation;
+		in = &prog->code[pc];
+		
+		switch (in->op) {
+		case OP_JMP:
+			stack[top++] = in->x;
+			stack[top++] = -1;
+			stack[top++] = 0;
+			break;
+		
+		case OP_SPLIT:
+			stack[top++] = in->y;
+			stack[top++] = -1;
+			stack[top++] = 0;
+			stack[top++] = in->x;
+			stack[top++] = -1;
+			stack[top++] = 0;
+			break;
+		
+		case OP_SAVE:
+			stack[top++] = 0;
+			stack[top++] = in->x;
+			stack[top++] = working[in->x];
+			working[in->x] = sp;
+			stack[top++] = pc + 1;
+			stack[top++] = -1;
+			stack[top++] = 0;
+			break;
+		
+		case OP_BOL: case OP_EOL: case OP_BOUNDARY: case OP_NOT_BOUNDARY:
+		case OP_WORD_START: case OP_WORD_END:
+			if (holds(in->op, text, sp)) {
+				stack[top++] = pc + 1;
+				stack[top++] = -1;
+				stack[top++] = 0;
+			}
+			break;
+		
+		default:
+			list->pcs[list->count] = pc;
+			memcpy(&list->caps[list->count * width], working, width * sizeof(int));
+			list->count++;
+			break;
+		}
+	}
+}
+
+/* Run the program over text from start, returning 1 (with the first width slots of
+   prog->matched set) if it matches.  If anchored, the match must begin at start. */
+static int run(nfa_prog* prog, const char* text, int start, int width, int anchored) {
+	threadlist *clist = &prog->lists[0], *nlist = &prog->lists[1], *swap;
+	unsigned char c;
+	int sp, i, matched = 0;
+	
+	clist->count = 0;
+	clist->generation = ++prog->generation;
+	
+	for (sp = start; ; sp++) {
+		c = (unsigned char) text[sp];
+		
+		/* a new thread starts at each place until a match is found, after all the
+		   threads that started sooner, including at the end of the text, where only an
+		   empty match can be found */
+		if (!matched && (!anchored || (sp == start))) {
+			for (i = 0; i < prog->nsave; i++) {
+				prog->working[i] = -1;
+			}
+			addThread(prog, clist, 0, text, sp, width);
+		}
+		
+		/* with no threads left, only a new one (past an assertion that failed here) can
+		   find a match */
+		if ((clist->count == 0) && (matched || anchored || (c == '\0'))) {
+			break;
+		}
+		
+		nlist->count = 0;
+		nlist->generation = ++prog->generation;
+		
+		for (i = 0; i < clist->count; i++) {
+			if (prog->code[clist->pcs[i]].op == OP_MATCH) {
+				/* the threads after this one are less preferred, so they are dropped */
+				memcpy(prog->matched, &clist->caps[i * width], width * sizeof(int));
+				matched = 1;
+				break;
+			}
+			
+			if (accepts(prog, clist->pcs[i], c)) {
+				memcpy(prog->working, &clist->caps[i * width], width * sizeof(int));
+				addThread(prog, nlist, clist->pcs[i] + 1, text, sp + 1, width);
+			}
+		}
+		
+		swap = clist;
+		clist = nlist;
+		nlist = swap;
+		
+		if (c == '\0') {
+			break;
+		}
+	}
+	
+	return matched;
+}
+
+/* Add the characters read by the instruction at pc to cls, returning non-zero if any
+   of them were already there. */
+static int addReads(nfa_prog* prog, int pc, charclass cls) {
+	int c, overlap = 0;
+	
+	for (c = 1; c < 256; c++) {
+		if (accepts(prog, pc, (unsigned char) c)) {
+			overlap |= cls[c >> 3] & (1 << (c & 7));
+			addToClass(cls, c);
+		}
+	}
+	
+	return overlap;
+}
+
+/* Build the one-pass automaton for the program, if it is one-pass.  Each state begins
+   at the start of the program or just after an instruction that reads a character,
+   and its steps are found by following the instructions that don't, in order of
+   preference as addThread would.  The pattern is one-pass if no two of the steps out
+   of a state can read the same character, and no step depends on the ends of the line
+   while another way reaches the same instruction. */
+static void buildOnePass(nfa_prog* prog) {
+	int *stateAfter, *starts, *seen, *path, *stack = prog->stack;
+	int maxSteps = 2 * prog->length + 2, maxSaves = 4 * prog->length + 8;
+	int states = 1, nsteps = 0, nsaves = 0, onePass = 1;
+	int state, pc, top, depth, conditions, revisited, conditional;
+	charclass used;
+	instruction* in;
+	step* s;
+	
+	stateAfter = (int*) malloc(prog->length * sizeof(int));
+	starts = (int*) malloc((prog->length + 1) * sizeof(int));
+	seen = (int*) malloc(prog->length * sizeof(int));
+	path = (int*) malloc(prog->length * sizeof(int));
+	prog->steps = (step*) malloc(maxSteps * sizeof(step));
+	prog->firstStep = (int*) malloc((prog->length + 2) * sizeof(int));
+	prog->saves = (int*) malloc(maxSaves * sizeof(int));
+	
+	if ((stateAfter == NULL) || (starts == NULL) || (seen == NULL) || (path == NULL) ||
+		(prog->steps == NULL) || (prog->firstStep == NULL) || (prog->saves == NULL)) {
+		onePass = 0;
+	} else {
+		starts[0] = 0;
+		
+		for (pc = 0; pc < prog->length; pc++) {
+			seen[pc] = NO_NODE;
+			
+			/* the instructions that read a character come first */
+			if (prog->code[pc].op <= OP_CLASS) {
+				starts[states] = pc + 1;
+				stateAfter[pc] = states++;
+			}
+		}
+	}
+	
+	for (state = 0; onePass && (state < states); state++) {
+		prog->firstStep[state] = nsteps;
+		memset(used, 0, sizeof(used));
+		revisited = conditional = 0;
+		
+		top = 0;
+		stack[top++] = starts[state];
+		stack[top++] = 0;
+		stack[top++] = 0;
+		
+		while (top > 0) {
+			conditions = stack[--top];
+			depth = stack[--top];
+			pc = stack[--top];
+			
+			if (seen[pc] == state) {
+				revisited = 1;
+				continue;
+			}
+			
+			seen[pc] = state;
+			in = &prog->code[pc];
+			
+			switch (in->op) {
+			case OP_JMP:
+				stack[top++] = in->x;
+				stack[top++] = depth;
+				stack[top++] = conditions;
+				break;
+			
+			case OP_SPLIT:
+				stack[top++] = in->y;
+				stack[top++] = depth;
+				stack[top++] = conditions;
+				stack[top++] = in->x;
+				stack[top++] = depth;
+				stack[top++] = conditions;
+				break;
+			
+			case OP_SAVE:
+				path[depth] = in->x;
+				stack[top++] = pc + 1;
+				stack[top++] = depth + 1;
+				stack[top++] = conditions;
+				break;
+			
+			case OP_BOL: case OP_EOL: case OP_BOUNDARY: case OP_NOT_BOUNDARY:
+			case OP_WORD_START: case OP_WORD_END:
+				conditional = 1;
+				stack[top++] = pc + 1;
+				stack[top++] = depth;
+				stack[top++] = conditions | CONDITION(in->op);
+				break;
+			
+			default:
+				if (in->op != OP_MATCH) {
+					/* nothing is read at the end of the line */
+					if ((conditions & CONDITION(OP_EOL)) != 0) {
+						break;
+					}
+					
+					if (addReads(prog, pc, used)) {
+						onePass = 0;
+					}
+				}
+				
+				if ((nsteps == maxSteps) || (nsaves + depth > maxSaves)) {
+					onePass = 0;
+				}
+				
+				if (!onePass) {
+					top = 0;
+					break;
+				}
+				
+				s = &prog->steps[nsteps++];
+				s->pc = (in->op == OP_MATCH) ? -1 : pc;
+				s->target = (in->op == OP_MATCH) ? NO_NODE : stateAfter[pc];
+				s->conditions = conditions;
+				s->firstSave = nsaves;
+				s->saveCount = depth;
+				memcpy(&prog->saves[nsaves], path, depth * sizeof(int));
+				nsaves += depth;
+				
+				/* the ways on that are less preferred than a match are never taken, unless
+				   it depends on an assertion that may not hold */
+				if ((in->op == OP_MATCH) && (conditions == 0)) {
+					top = 0;
+				}
+				break;
+			}
+		}
+		
+		if (revisited && conditional) {
+			onePass = 0;
+		}
+	}
+	
+	if (onePass) {
+		prog->firstStep[states] = nsteps;
+	} else {
+		free(prog->steps);
+		free(prog->firstStep);
+		free(prog->saves);
+		prog->steps = NULL;
+		prog->firstStep = NULL;
+		prog->saves = NULL;
+	}
+	
+	free(stateAfter);
+	free(starts);
+	free(seen);
+	free(path);
+}
+
+/* Run the one-pass automaton over text from start, returning 1 (with prog->matched
+   set) if a match begins there. */
+static int runOnePass(nfa_prog* prog, const char* text, int start) {
+	int* slots = prog->working;
+	step *s, *take, *last;
+	int state = 0, sp = start, i, matched = 0;
+	unsigned char c;
+	
+	for (i = 0; i < prog->nsave; i++) {
+		slots[i] = -1;
+	}
+	
+	for (;;) {
+		c = (unsigned char) text[sp];
+		take = NULL;
+		last = &prog->steps[prog->firstStep[state + 1]];
+		
+		/* at most one step can read c, but a match may be found on the way to it */
+		for (s = &prog->steps[prog->firstStep[state]]; s < last; s++) {
+			if ((s->conditions != 0) && !conditionsHold(s->conditions, text, sp)) {
+				continue;
+			}
+			
+			if (s->pc < 0) {
+				memcpy(prog->matched, slots, prog->nsave * sizeof(int));
+				
+				for (i = 0; i < s->saveCount; i++) {
+					prog->matched[prog->saves[s->firstSave + i]] = sp;
+				}
+				
+				matched = 1;
+				break;
+			}
+			
+			if ((c != '\0') && accepts(prog, s->pc, c)) {
+				take = s;
+			}
+		}
+		
+		if (take == NULL) {
+			break;
+		}
+		
+		for (i = 0; i < take->saveCount; i++) {
+			slots[prog->saves[take->firstSave + i]] = sp;
+		}
+		
+		state = take->target;
+		sp++;
+	}
+	
+	return matched;
+}
+
+
+
+/* Public functions: */
+int nfa_is_extended(const char* pattern) {
+	for (; *pattern != '\0'; pattern++) {
+		if (*pattern == '\\') {
+			if (*++pattern == '\0') {
+				break;
+			}
+		} else if (strchr("|(){", *pattern) != NULL) {
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+nfa_prog* nfa_compile(const char* pattern, int flags) {
+	nfa_prog* prog;
+	parser ps;
+	node* root;
+	int size = (int) strlen(pattern);
+	int i;
+	
+	ps.p = pattern;
+	ps.size = 3 * size + 4;
+	ps.used = 0;
+	ps.groups = 0;
+	ps.depth = 0;
+	ps.error = 0;
+	ps.nclasses = 0;
+	ps.pool = (node*) malloc(ps.size * sizeof(node));
+	ps.classes = (charclass*) malloc((size + 1) * sizeof(charclass));
+	
+	if ((prog = (nfa_prog*) calloc(1, sizeof(nfa_prog))) == NULL) {
+		free(ps.pool);
+		free(ps.classes);
+		return NULL;
+	}
+	
+	prog->classes = ps.classes;
+	prog->lastStart = -1;
+	
+	if ((ps.pool == NULL) || (ps.classes == NULL)) {
+		free(ps.pool);
+		nfa_free(prog);
+		return NULL;
+	}
+	
+	root = parseAlternation(&ps);
+	
+	if ((root == NULL) || ps.error || (*ps.p != '\0') || (programSize(root) + 5 > MAX_PROGRAM)) {
+		free(ps.pool);
+		nfa_free(prog);
+		return NULL;
+	}
+	
+	if (ps.nclasses > 0) {
+		prog->classes = (charclass*) realloc(ps.classes, ps.nclasses * sizeof(charclass));
+	}
+	
+	/* the program saves the bounds of the whole match around the pattern, and inside them
+	   checks that it is a whole line or word if it must be */
+	prog->nsave = 2 * (ps.groups + 1);
+	prog->code = (instruction*) malloc((programSize(root) + 5) * sizeof(instruction));
+	
+	if (prog->code == NULL) {
+		free(ps.pool);
+		nfa_free(prog);
+		return NULL;
+	}
+	
+	emit(prog, OP_SAVE, 0, 0);
+	
+	if ((flags & NFA_LINE) != 0) {
+		emit(prog, OP_BOL, 0, 0);
+	} else if ((flags & NFA_WORD) != 0) {
+		emit(prog, OP_WORD_START, 0, 0);
+	}
+	
+	emitNode(prog, root);
+	
+	if ((flags & NFA_LINE) != 0) {
+		emit(prog, OP_EOL, 0, 0);
+	} else if ((flags & NFA_WORD) != 0) {
+		emit(prog, OP_WORD_END, 0, 0);
+	}
+	
+	emit(prog, OP_SAVE, 1, 0);
+	emit(prog, OP_MATCH, 0, 0);
+	
+	findLiteral(prog, root);
+	free(ps.pool);
+	
+	/* at most one thread per instruction, and a frame of three on the stack for each
+	   way into one */
+	prog->onList = (long*) malloc(prog->length * sizeof(long));
+	prog->stack = (int*) malloc(3 * (2 * prog->length + 1) * sizeof(int));
+	prog->working = (int*) malloc(prog->nsave * sizeof(int));
+	prog->matched = (int*) malloc(prog->nsave * sizeof(int));
+	
+	for (i = 0; i < 2; i++) {
+		prog->lists[i].pcs = (int*) malloc(prog->length * sizeof(int));
+		prog->lists[i].caps = (int*) malloc(prog->length * prog->nsave * sizeof(int));
+		
+		if ((prog->lists[i].pcs == NULL) || (prog->lists[i].caps == NULL)) {
+			nfa_free(prog);
+			return NULL;
+		}
+	}
+	
+	if ((prog->onList == NULL) || (prog->stack == NULL) || (prog->working == NULL) ||
+		(prog->matched == NULL)) {
+		nfa_free(prog);
+		return NULL;
+	}
+	
+	for (i = 0; i < prog->length; i++) {
+		prog->onList[i] = 0;
+	}
+	
+	if (prog->nsave > 2) {
+		buildOnePass(prog);
+	}
+	
+	return prog;
+}
+
+int nfa_find_next(nfa_prog* prog, const char* text, int* offset, int* matchlength) {
+	int start;
+	
+	*matchlength = 0;
+	prog->lastStart = -1;
+	
+	/* only the bounds of the whole match are kept while looking for one */
+	if ((*offset < 0) || !run(prog, text, *offset, 2, 0)) {
+		*offset = -1;
+		return -1;
+	}
+	
+	start = prog->lastStart = prog->matched[0];
+	*matchlength = prog->matched[1] - start;
+	/* an empty match at the end of the text is the last one it can have */
+	*offset = (text[start] == '\0') ? -1 : start + ((*matchlength > 0) ? *matchlength : 1);
+	
+	return start;
+}
+
+int nfa_groups(nfa_prog* prog) {
+	return prog->nsave / 2 - 1;
+}
+
+int nfa_submatches(nfa_prog* prog, const char* text, int* spans) {
+	int groups = nfa_groups(prog), matched, i;
+	
+	if ((groups == 0) || (prog->lastStart < 0)) {
+		matched = 0;
+	} else if (prog->steps != NULL) {
+		matched = runOnePass(prog, text, prog->lastStart);
+	} else {
+		matched = run(prog, text, prog->lastStart, prog->nsave, 1);
+	}
+	
+	for (i = 0; i < 2 * groups; i++) {
+		spans[i] = matched ? prog->matched[i + 2] : -1;
+	}
+	
+	return groups;
+}
+
+int nfa_literal(nfa_prog* prog, char* literal, int size) {
+	int length = (prog->literalLength < size) ? prog->literalLength : size;
+	
+	memcpy(literal, prog->literal, length);
+	
+	return length;
+}
+
+void nfa_free(nfa_prog* prog) {
+	if (prog != NULL) {
+		free(prog->code);
+		free(prog->classes);
+		free(prog->lists[0].pcs);
+		free(prog->lists[0].caps);
+		free(prog->lists[1].pcs);
+		free(prog->lists[1].caps);
+		free(prog->onList);
+		free(prog->stack);
+		free(prog->working);
+		free(prog->matched);
+		free(prog->steps);
+		free(prog->firstStep);
+		free(prog->saves);
+		free(prog);
+	}
+}
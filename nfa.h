@@ -0,0 +1,75 @@
+/*
+ * Regular expressions with alternation, grouping and bounded repetition.
+ *
+ * The patterns that re.c can't take, those using |, ( ) or {n,m}, are parsed into a tree
+ * and compiled into a program for a Pike VM, which runs every thread of the automaton
+ * in step along the text, so a line is read once however many ways the pattern
+ * branches and nothing is ever backtracked over.  A counted repeat is written out as
+ * that many copies of its operand, so the program grows with the count and not with
+ * every combination of choices.
+ */
+
+#ifndef _GSGREP_NFA_H
+#define _GSGREP_NFA_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define NFA_MAX_GROUPS 9
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct nfa_prog nfa_prog;
+
+
+/* Returns non-zero if pattern uses alternation, grouping or bounded repetition, which
+   only nfa_compile understands. */
+int nfa_is_extended(const char* pattern);
+
+
+/* Flags for nfa_compile: a match must be a whole word (with no word character just
+   before or after it), or the whole line. */
+#define NFA_WORD 1
+#define NFA_LINE 2
+
+
+/* Compile pattern, with the assertions that flags call for around it, returning NULL if
+   it is not a valid expression, would make too large a program, or there is not enough
+   memory. */
+nfa_prog* nfa_compile(const char* pattern, int flags);
+
+
+/* Find the next match of the compiled pattern inside text, starting at *offset, as
+   re_find_next does.  Of the matches starting at the same place, the one the pattern
+   prefers is taken: the first alternative that matches, and as many repeats as will
+   match (or as few, for '?'). */
+int nfa_find_next(nfa_prog* prog, const char* text, int* offset, int* matchlength);
+
+
+/* Returns the number of groups in the compiled pattern. */
+int nfa_groups(nfa_prog* prog);
+
+
+/* Find the groups of the match that the last call to nfa_find_next found in text,
+   setting spans[2 * (n - 1)] and spans[2 * (n - 1) + 1] to where group n started and
+   ended, or both to -1 if the group took no part in the match.  Returns the number of
+   groups.  A one-pass pattern has its groups found by a single scan from the start of
+   the match; others are run through the Pike VM again. */
+int nfa_submatches(nfa_prog* prog, const char* text, int* spans);
+
+
+/* Copy the literal that every match of the compiled pattern must contain, as
+   re_literal does. */
+int nfa_literal(nfa_prog* prog, char* literal, int size);
+
+
+/* Release a program made by nfa_compile. */
+void nfa_free(nfa_prog* prog);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_NFA_H */
@@ -0,0 +1,236 @@
+/*
+ * Buffered output for gsgrep.
+ */
+
+#include "output.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+
+/* see the note on SLASH_N in grep.c; the console wants CR as the end of line. */
+#define OUT_NEWLINE '\015'
+#else
+#define OUT_NEWLINE '\012'
+#endif
+
+#define OUT_BUFFER_SIZE 4096
+
+static char outBuffer[OUT_BUFFER_SIZE];
+static int outUsed = 0;
+static FILE* outCopy = NULL;
+
+static const char hexDigits[] = "0123456789abcdef";
+
+void out_flush(void) {
+	if (outUsed > 0) {
+		fwrite(outBuffer, 1, outUsed, stdout);
+		
+		if (outCopy != NULL) {
+			fwrite(outBuffer, 1, outUsed, outCopy);
+		}
+		
+		outUsed = 0;
+	}
+	
+	fflush(stdout);
+}
+
+void out_copy(FILE* copy) {
+	out_flush();
+	outCopy = copy;
+}
+
+void out_write(const char* data, long len) {
+	long room;
+	
+	while (len > 0) {
+		room = OUT_BUFFER_SIZE - outUsed;
+		
+		if (room == 0) {
+			out_flush();
+			room = OUT_BUFFER_SIZE;
+		}
+		
+		if (len < room) {
+			room = len;
+		}
+		
+		memcpy(&outBuffer[outUsed], data, room);
+		outUsed += (int) room;
+		data += room;
+		len -= room;
+	}
+}
+
+void out_str(const char* str) {
+	out_write(str, strlen(str));
+}
+
+void out_char(char c) {
+	if (outUsed == OUT_BUFFER_SIZE) {
+		out_flush();
+	}
+	
+	outBuffer[outUsed++] = c;
+}
+
+void out_newline(void) {
+	out_char(OUT_NEWLINE);
+}
+
+void out_long(long n) {
+	/* each byte of a long gives at most three digits, and there may be a sign */
+	char digits[sizeof(long) * 3 + 1];
+	int idx = sizeof digits;
+	unsigned long value = (n < 0) ? -(unsigned long) n : (unsigned long) n;
+	
+	do {
+		digits[--idx] = (char) ('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+	
+	if (n < 0) {
+		digits[--idx] = '-';
+	}
+	
+	out_write(&digits[idx], sizeof digits - idx);
+}
+
+/* Returns the number of bytes at the start of data that can be written into a JSON
+   string as they are; that is everything other than '"', '\', control characters and
+   bytes with the high bit set, which are only written as they are if they are UTF-8. */
+static long json_plain_length(const unsigned char* data, long len) {
+	long idx = 0;
+	
+	#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	
+	while (idx + 16 <= len) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) &data[idx]);
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+		int mask = _mm_movemask_epi8(special) | _mm_movemask_epi8(chunk);
+		
+		if (mask != 0) {
+			return idx + __builtin_ctz(mask);
+		}
+		
+		idx += 16;
+	}
+	#endif
+	
+	while ((idx < len) && (data[idx] >= 0x20) && (data[idx] < 0x80) && (data[idx] != '"') &&
+		   (data[idx] != '\\')) {
+		idx++;
+	}
+	
+	return idx;
+}
+
+/* Returns the length of the UTF-8 character at the start of data, or 0 if it doesn't
+   start with one: a stray continuation byte, a sequence cut short, or one that is
+   overlong, a surrogate or past U+10FFFF. */
+static int utf8_length(const unsigned char* data, long len) {
+	unsigned char c = data[0], low = 0x80, high = 0xbf;
+	int length, idx;
+	
+	if ((c >= 0xc2) && (c <= 0xdf)) {
+		length = 2;
+	} else if ((c >= 0xe0) && (c <= 0xef)) {
+		length = 3;
+		
+		if (c == 0xe0) {
+			low = 0xa0;
+		} else if (c == 0xed) {
+			high = 0x9f;
+		}
+	} else if ((c >= 0xf0) && (c <= 0xf4)) {
+		length = 4;
+		
+		if (c == 0xf0) {
+			low = 0x90;
+		} else if (c == 0xf4) {
+			high = 0x8f;
+		}
+	} else {
+		return 0;
+	}
+	
+	if (len < length) {
+		return 0;
+	}
+	
+	/* only the first continuation byte has a narrower range */
+	for (idx = 1; idx < length; idx++) {
+		if ((data[idx] < low) || (data[idx] > high)) {
+			return 0;
+		}
+		
+		low = 0x80;
+		high = 0xbf;
+	}
+	
+	return length;
+}
+
+void out_json_string(const char* data, long len) {
+	long plain;
+	unsigned char c;
+	int length;
+	
+	out_char('"');
+	
+	while (len > 0) {
+		plain = json_plain_length((const unsigned char*) data, len);
+		
+		if (plain > 0) {
+			out_write(data, plain);
+			data += plain;
+			len -= plain;
+			
+			if (len == 0) {
+				break;
+			}
+		}
+		
+		/* a byte that isn't part of a UTF-8 character is escaped as the Latin-1
+		   character with its code, so that the output is always valid UTF-8 */
+		if ((*data & 0x80) && ((length = utf8_length((const unsigned char*) data, len)) > 0)) {
+			out_write(data, length);
+			data += length;
+			len -= length;
+			continue;
+		}
+		
+		c = (unsigned char) *data++;
+		len--;
+		
+		out_char('\\');
+		
+		switch (c) {
+		case '"':  out_char('"'); break;
+		case '\\': out_char('\\'); break;
+		case '\b': out_char('b'); break;
+		case '\f': out_char('f'); break;
+		case '\t': out_char('t'); break;
+		case 0x0a: out_char('n'); break;
+		case 0x0d: out_char('r'); break;
+		default:
+			out_str("u00");
+			out_char(hexDigits[c >> 4]);
+			out_char(hexDigits[c & 0x0f]);
+			break;
+		}
+	}
+	
+	out_char('"');
+}
@@ -0,0 +1,57 @@
+/*
+ * Buffered output for gsgrep.
+ *
+ * All of the text written to standard output goes through a single buffer, so
+ * that a line made up of a prefix, a few highlighted matches and the rest of the
+ * text costs one write rather than one per fragment.  The module also knows how
+ * to write a JSON string, for the --json output mode.
+ */
+
+#ifndef _GSGREP_OUTPUT_H
+#define _GSGREP_OUTPUT_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Append len bytes of data to the output buffer. */
+void out_write(const char* data, long len);
+
+
+/* Append a nul terminated string to the output buffer. */
+void out_str(const char* str);
+
+
+/* Append a single character to the output buffer. */
+void out_char(char c);
+
+
+/* Append the end of line sequence used by the console (CR on the IIGS, LF elsewhere). */
+void out_newline(void);
+
+
+/* Append the decimal representation of n. */
+void out_long(long n);
+
+
+/* Append len bytes of data as a quoted JSON string, escaping as required. */
+void out_json_string(const char* data, long len);
+
+
+/* Write anything buffered to stdout. */
+void out_flush(void);
+
+
+/* Write anything buffered, and from then on write a copy of everything written to
+   stdout to copy as well, until out_copy is called again (with NULL to stop). */
+void out_copy(FILE* copy);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_OUTPUT_H */
@@ -227,8 +227,10 @@ reverse(char *v[], int i, int j)
  * This function assumes there is no `--` element, and the last element
  * is not an option missing a required argument.
  *
- * The algorithm is described here:
- * http://hardtoc.com/2016/11/07/reordering-arguments.html
+ * Makes a single pass over `argv`, moving each option (and its argument)
+ * down to follow the options before it, and setting the nonoptions aside,
+ * then puts the nonoptions back after the options. The relative order of
+ * both is kept, and the time taken is linear in `argc`.
  */
 static int
 parg_reorder_simple(int argc, char *argv[],
@@ -236,77 +238,54 @@ parg_reorder_simple(int argc, char *argv[],
                     const struct parg_option *longopts)
 {
 	struct parg_state ps;
-	int change;
-	int l = 0;
-	int m = 0;
-	int r = 0;
+	char **nonopts;
+	int numopts = 1;
+	int numnonopts = 0;
+	int i;
 
 	if (argc < 2) {
 		return argc;
 	}
 
-	do {
-		int nextind;
-		int c;
+	nonopts = (char **) malloc(argc * sizeof(char *));
 
-		parg_init(&ps);
+	if (nonopts == NULL) {
+		return -1;
+	}
+
+	parg_init(&ps);
 
-		nextind = ps.optind;
+	for (;;) {
+		int start = ps.optind;
+		int c;
 
 		/* Parse until end of argument */
 		do {
 			c = parg_getopt_long(&ps, argc, argv, optstring, longopts, NULL);
 		} while (ps.nextchar != NULL && *ps.nextchar != '\0');
 
-		change = 0;
-
-		do {
-			/* Find next non-option */
-			for (l = nextind; c != 1 && c != -1;) {
-				l = ps.optind;
-
-				do {
-					c = parg_getopt_long(&ps, argc, argv, optstring, longopts, NULL);
-				} while (ps.nextchar != NULL && *ps.nextchar != '\0');
-			}
-
-			/* Find next option */
-			for (m = l; c == 1;) {
-				m = ps.optind;
-
-				do {
-					c = parg_getopt_long(&ps, argc, argv, optstring, longopts, NULL);
-				} while (ps.nextchar != NULL && *ps.nextchar != '\0');
-			}
-
-			/* Find next non-option */
-			for (r = m; c != 1 && c != -1;) {
-				r = ps.optind;
+		if (c == -1) {
+			break;
+		}
 
-				do {
-					c = parg_getopt_long(&ps, argc, argv, optstring, longopts, NULL);
-				} while (ps.nextchar != NULL && *ps.nextchar != '\0');
+		if (c == 1) {
+			nonopts[numnonopts++] = argv[start];
+		}
+		else {
+			/* Options only ever move down, to slots already parsed */
+			for (i = start; i < ps.optind; ++i) {
+				argv[numopts++] = argv[i];
 			}
+		}
+	}
 
-			/* Find next option */
-			for (nextind = r; c == 1;) {
-				nextind = ps.optind;
-
-				do {
-					c = parg_getopt_long(&ps, argc, argv, optstring, longopts, NULL);
-				} while (ps.nextchar != NULL && *ps.nextchar != '\0');
-			}
+	for (i = 0; i < numnonopts; ++i) {
+		argv[numopts + i] = nonopts[i];
+	}
 
-			if (m < r) {
-				change = 1;
-				reverse(argv, l, m);
-				reverse(argv, m, r);
-				reverse(argv, l, r);
-			}
-		} while (c != -1);
-	} while (change != 0);
+	free(nonopts);
 
-	return l + (r - m);
+	return numopts;
 }
 
 int
@@ -343,6 +322,10 @@ parg_reorder(int argc, char *argv[],
 
 	optend = parg_reorder_simple(lastind, argv, optstring, longopts);
 
+	if (optend < 0) {
+		return optend;
+	}
+
 	/* Rotate `--` or trailing option with error into position */
 	if (lastind < argc) {
 		reverse(argv, optend, lastind);
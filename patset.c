@@ -0,0 +1,549 @@
+/*
+ * Sets of regular expressions matched together.
+ *
+ * Each pattern's required literal (see re_literal) is filed under its first character,
+ * so that one walk along a line finds every literal it holds.  A bitmap of the pairs
+ * of characters the literals start with lets the walk pass over most of the line
+ * without looking at any pattern.
+ *
+ * A fixed string is its own literal, so unless it is too long to be filed whole it
+ * matches wherever the walk finds it, without going near the regular expression code.
+ */
+
+#include "patset.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+#define MAX_LITERAL            32
+#define INITIAL_SIZE           8
+#define NO_PATTERN             -1
+#define NO_FALLBACK            -1      /* fellBack of a pattern the automaton can't take */
+
+typedef struct {
+	re_t          regex;           /* NULL for a fixed string or an extended pattern */
+	nfa_prog*     program;         /* the pattern, if only nfa.c can take it      */
+	char*         source;          /* the text of a regex, should it go over the budget */
+	int           fellBack;        /* the order it went over to the automaton in, 0 or NO_FALLBACK */
+	char*         fixed;           /* the text of a fixed string, nul terminated  */
+	int           fixedLength;
+	char          literal[MAX_LITERAL + 1];  /* nul terminated */
+	int           literalLength;
+	int           nextSameFirst;   /* the next pattern whose literal starts alike */
+} pattern;
+
+struct pattern_set {
+	pattern*      patterns;
+	int           count;
+	int           size;
+	int           unfiltered;      /* the number of patterns without a literal    */
+	int           errors;          /* the errors allowed in a match               */
+	int           flags;           /* RE_WORD or RE_LINE, if matches must be whole */
+	int           lastPattern;     /* the pattern patset_find_next last found     */
+	long          budget;          /* the backtracking allowed on a line, or 0    */
+	int           fallbacks;       /* the patterns that have gone over it         */
+	int           byFirst[256];    /* the first pattern whose literal starts with each character */
+	unsigned char pairs[8192];     /* a bit for each pair of characters a literal starts with */
+	unsigned char* seen;           /* the patterns whose literal is in the line   */
+};
+
+
+
+/* Private functions: */
+
+static int isWordChar(char c) {
+	return isalnum((unsigned char) c) || (c == '_');
+}
+
+/* Returns non-zero if the length characters at start of text are a whole word or line,
+   as the set's flags require. */
+static int isWhole(pattern_set* set, const char* text, int start, int length) {
+	if ((set->flags & RE_LINE) != 0) {
+		return (start == 0) && (text[start + length] == '\0');
+	} else if ((set->flags & RE_WORD) != 0) {
+		return ((start == 0) || !isWordChar(text[start - 1])) && !isWordChar(text[start + length]);
+	}
+	
+	return 1;
+}
+
+/* Hand the regex p over to the automaton, having gone over the budget, or if it won't
+   compile for it, leave it to backtrack without a limit. */
+static void fallBack(pattern_set* set, pattern* p) {
+	if ((p->program = nfa_compile(p->source, ((set->flags & RE_WORD) ? NFA_WORD : 0) |
+		((set->flags & RE_LINE) ? NFA_LINE : 0))) != NULL) {
+		p->fellBack = ++set->fallbacks;
+	} else {
+		p->fellBack = NO_FALLBACK;
+	}
+}
+
+/* Find the next match of p inside text, as re_find_next does. */
+static int findNext(pattern_set* set, pattern* p, const char* text, int* offset, int* matchlength) {
+	const char* found;
+	int from = *offset;
+	int index;
+	
+	if ((p->regex != NULL) && (p->program == NULL)) {
+		if (set->errors > 0) {
+			return re_find_approx(p->regex, set->errors, text, offset, matchlength);
+		}
+		
+		re_set_budget((p->fellBack == 0) ? set->budget : 0);
+		
+		if ((index = re_find_next(p->regex, text, offset, matchlength)) != RE_OVER_BUDGET) {
+			return index;
+		}
+		
+		/* the line is matched afresh, the other way */
+		fallBack(set, p);
+		*offset = from;
+		return findNext(set, p, text, offset, matchlength);
+	} else if (p->program != NULL) {
+		return nfa_find_next(p->program, text, offset, matchlength);
+	}
+	
+	*matchlength = 0;
+	
+	/* a fixed string that isn't a whole word only rules out the place it was found */
+	do {
+		if ((from < 0) || (p->fixedLength == 0) || ((found = strstr(&text[from], p->fixed)) == NULL)) {
+			*offset = -1;
+			return -1;
+		}
+		
+		from = (int) (found - text) + 1;
+	} while (!isWhole(set, text, (int) (found - text), p->fixedLength));
+	
+	*matchlength = p->fixedLength;
+	*offset = (int) (found - text) + p->fixedLength;
+	
+	return (int) (found - text);
+}
+
+/* Returns the first match of p in text, and its length in *matchlength, or -1. */
+static int findPattern(pattern_set* set, pattern* p, const char* text, int* matchlength) {
+	const char* found;
+	int offset = 0;
+	
+	if ((p->fixed == NULL) || (set->flags != 0)) {
+		return findNext(set, p, text, &offset, matchlength);
+	}
+	
+	*matchlength = p->fixedLength;
+	
+	return ((found = strstr(text, p->fixed)) != NULL) ? (int) (found - text) : -1;
+}
+
+/* Add the pattern filled in at the end of the set, filing its literal. */
+static int addPattern(pattern_set* set) {
+	pattern* p = &set->patterns[set->count];
+	
+	p->literal[p->literalLength] = '\0';
+	p->nextSameFirst = NO_PATTERN;
+	
+	if (p->literalLength > 0) {
+		unsigned char first = (unsigned char) p->literal[0];
+		unsigned int pair;
+		
+		p->nextSameFirst = set->byFirst[first];
+		set->byFirst[first] = set->count;
+		
+		/* a literal of one character may be followed by anything */
+		for (pair = (unsigned int) first << 8; pair < ((unsigned int) first + 1) << 8; pair++) {
+			if ((p->literalLength == 1) || ((pair & 0xFF) == (unsigned char) p->literal[1])) {
+				set->pairs[pair >> 3] |= (unsigned char) (1 << (pair & 7));
+			}
+		}
+	} else {
+		set->unfiltered++;
+	}
+	
+	return set->count++;
+}
+
+/* Make room in the set for one more pattern. */
+static int growSet(pattern_set* set) {
+	if (set->count == set->size) {
+		int size = (set->size == 0) ? INITIAL_SIZE : set->size * 2;
+		pattern* patterns = (pattern*) realloc(set->patterns, size * sizeof(pattern));
+		unsigned char* seen;
+		
+		if (patterns == NULL) {
+			return -1;
+		}
+		
+		set->patterns = patterns;
+		
+		if ((seen = (unsigned char*) realloc(set->seen, size)) == NULL) {
+			return -1;
+		}
+		
+		set->seen = seen;
+		set->size = size;
+	}
+	
+	return 0;
+}
+
+/* Mark in set->seen the patterns whose literal appears in text. */
+static void findLiterals(pattern_set* set, const char* text) {
+	const unsigned char* p;
+	int i;
+	
+	memset(set->seen, 0, set->count);
+	
+	for (p = (const unsigned char*) text; *p != '\0'; p++) {
+		unsigned int pair = ((unsigned int) p[0] << 8) | p[1];
+		
+		if ((set->pairs[pair >> 3] & (1 << (pair & 7))) == 0) {
+			continue;
+		}
+		
+		for (i = set->byFirst[*p]; i != NO_PATTERN; i = set->patterns[i].nextSameFirst) {
+			if (!set->seen[i] &&
+				(strncmp((const char*) p, set->patterns[i].literal, set->patterns[i].literalLength) == 0)) {
+				set->seen[i] = 1;
+			}
+		}
+	}
+}
+
+
+
+/* Public functions: */
+pattern_set* patset_new(void) {
+	pattern_set* set;
+	int c;
+	
+	if ((set = (pattern_set*) malloc(sizeof(pattern_set))) == NULL) {
+		return NULL;
+	}
+	
+	set->patterns = NULL;
+	set->seen = NULL;
+	set->count = 0;
+	set->size = 0;
+	set->unfiltered = 0;
+	set->errors = 0;
+	set->flags = 0;
+	set->lastPattern = NO_PATTERN;
+	set->budget = 0;
+	set->fallbacks = 0;
+	
+	for (c = 0; c < 256; c++) {
+		set->byFirst[c] = NO_PATTERN;
+	}
+	
+	memset(set->pairs, 0, sizeof(set->pairs));
+	
+	return set;
+}
+
+int patset_add(pattern_set* set, const char* text) {
+	pattern* p;
+	
+	if (growSet(set) != 0) {
+		return -1;
+	}
+	
+	p = &set->patterns[set->count];
+	p->fixed = NULL;
+	p->fixedLength = 0;
+	p->regex = NULL;
+	p->program = NULL;
+	p->source = NULL;
+	p->fellBack = 0;
+	
+	/* alternation, groups and counted repeats are left to the automaton */
+	if (nfa_is_extended(text)) {
+		if (set->errors > 0) {
+			return -2;
+		}
+		
+		if ((p->program = nfa_compile(text, ((set->flags & RE_WORD) ? NFA_WORD : 0) |
+			((set->flags & RE_LINE) ? NFA_LINE : 0))) == NULL) {
+			return -1;
+		}
+		
+		p->literalLength = nfa_literal(p->program, p->literal, MAX_LITERAL);
+		return addPattern(set);
+	}
+	
+	if ((p->regex = re_compile_flags(text, set->flags)) == NULL) {
+		return -1;
+	}
+	
+	if (set->errors > 0) {
+		/* a match with errors needn't hold any of the pattern's text */
+		if (!re_can_approx(p->regex)) {
+			re_free(p->regex);
+			return -2;
+		}
+		
+		p->literalLength = 0;
+	} else {
+		p->literalLength = re_literal(p->regex, p->literal, MAX_LITERAL);
+		
+		/* the text is kept to compile for the automaton, should the pattern need it */
+		if ((p->source = (char*) malloc(strlen(text) + 1)) == NULL) {
+			re_free(p->regex);
+			return -1;
+		}
+		
+		strcpy(p->source, text);
+	}
+	
+	return addPattern(set);
+}
+
+int patset_add_fixed(pattern_set* set, const char* text) {
+	pattern* p;
+	size_t length = strlen(text);
+	
+	if (set->errors > 0) {
+		return -2;
+	}
+	
+	if ((growSet(set) != 0) || (length > 0x7FFF)) {
+		return -1;
+	}
+	
+	p = &set->patterns[set->count];
+	p->regex = NULL;
+	p->program = NULL;
+	p->source = NULL;
+	p->fellBack = 0;
+	
+	if ((p->fixed = (char*) malloc(length + 1)) == NULL) {
+		return -1;
+	}
+	
+	strcpy(p->fixed, text);
+	p->fixedLength = (int) length;
+	p->literalLength = (p->fixedLength < MAX_LITERAL) ? p->fixedLength : MAX_LITERAL;
+	memcpy(p->literal, text, p->literalLength);
+	
+	return addPattern(set);
+}
+
+void patset_set_errors(pattern_set* set, int errors) {
+	set->errors = errors;
+}
+
+void patset_set_flags(pattern_set* set, int flags) {
+	set->flags = flags;
+}
+
+void patset_set_budget(pattern_set* set, long steps) {
+	pattern* p;
+	int i;
+	
+	set->budget = steps;
+	set->fallbacks = 0;
+	
+	/* the patterns that went over the last budget go back to backtracking */
+	for (i = 0; i < set->count; i++) {
+		p = &set->patterns[i];
+		
+		if ((p->fellBack > 0) && (p->regex != NULL)) {
+			nfa_free(p->program);
+			p->program = NULL;
+		}
+		
+		if (p->regex != NULL) {
+			p->fellBack = 0;
+		}
+	}
+}
+
+int patset_fallbacks(pattern_set* set) {
+	return set->fallbacks;
+}
+
+int patset_fell_back(pattern_set* set, int id) {
+	return (set->patterns[id].fellBack > 0) ? set->patterns[id].fellBack : 0;
+}
+
+int patset_count(pattern_set* set) {
+	return set->count;
+}
+
+int patset_match(pattern_set* set, const char* text, unsigned char* hits) {
+	int i, matchlength, matched = 0;
+	
+	/* a lone pattern has already had its literal found by the caller's scan */
+	if (set->count == 1) {
+		matched = (findPattern(set, &set->patterns[0], text, &matchlength) >= 0);
+		
+		if (hits != NULL) {
+			hits[0] = (unsigned char) matched;
+		}
+		
+		return matched;
+	}
+	
+	if (set->unfiltered < set->count) {
+		findLiterals(set, text);
+	}
+	
+	for (i = 0; i < set->count; i++) {
+		pattern* p = &set->patterns[i];
+		int hit;
+		
+		if ((p->fixed != NULL) && (p->literalLength == p->fixedLength) && (set->flags == 0)) {
+			/* a fixed string short enough to be filed whole was found by the walk */
+			hit = (p->literalLength == 0) || set->seen[i];
+		} else {
+			hit = ((p->literalLength == 0) || set->seen[i]) &&
+				(findPattern(set, p, text, &matchlength) >= 0);
+		}
+		
+		if (hits != NULL) {
+			hits[i] = (unsigned char) hit;
+		} else if (hit) {
+			return 1;
+		}
+		
+		matched += hit;
+	}
+	
+	return matched;
+}
+
+int patset_find_next(pattern_set* set, const char* text, int* offset, int* matchlength) {
+	int i, best = -1, bestLength = 0;
+	
+	if (set->count == 1) {
+		set->lastPattern = 0;
+		return findNext(set, &set->patterns[0], text, offset, matchlength);
+	}
+	
+	*matchlength = 0;
+	set->lastPattern = NO_PATTERN;
+	
+	if (*offset < 0) {
+		return -1;
+	}
+	
+	for (i = 0; i < set->count; i++) {
+		pattern* p = &set->patterns[i];
+		int from = *offset, start, length;
+		
+		/* a pattern whose literal is not in the rest of the line can't match there */
+		if ((p->fixed == NULL) && (p->literalLength > 0) && (strstr(&text[from], p->literal) == NULL)) {
+			continue;
+		}
+		
+		if ((start = findNext(set, p, text, &from, &length)) < 0) {
+			continue;
+		}
+		
+		if ((best < 0) || (start < best) || ((start == best) && (length > bestLength))) {
+			best = start;
+			bestLength = length;
+			set->lastPattern = i;
+		}
+	}
+	
+	if (best < 0) {
+		*offset = -1;
+		return -1;
+	}
+	
+	/* an empty match at the end of the line is the last one it can have */
+	*matchlength = bestLength;
+	*offset = (text[best] == '\0') ? -1 : best + ((bestLength > 0) ? bestLength : 1);
+	
+	return best;
+}
+
+int patset_submatches(pattern_set* set, const char* text, int* spans) {
+	pattern* p;
+	
+	if (set->lastPattern == NO_PATTERN) {
+		return 0;
+	}
+	
+	p = &set->patterns[set->lastPattern];
+	
+	return (p->program != NULL) ? nfa_submatches(p->program, text, spans) : 0;
+}
+
+int patset_literal(pattern_set* set, char* literal, int size) {
+	pattern* p = &set->patterns[0];
+	
+	if ((set->count != 1) || (set->errors > 0)) {
+		return 0;
+	}
+	
+	if (p->fixed != NULL) {
+		int length = (p->fixedLength < size) ? p->fixedLength : size;
+		
+		memcpy(literal, p->fixed, length);
+		return length;
+	} else if (p->program != NULL) {
+		return nfa_literal(p->program, literal, size);
+	}
+	
+	return re_literal(p->regex, literal, size);
+}
+
+int patset_profile_start(pattern_set* set) {
+	int i;
+	
+	for (i = 0; i < set->count; i++) {
+		if ((set->patterns[i].regex != NULL) && (set->patterns[i].program == NULL) && (set->errors == 0) &&
+			(re_profile_start(set->patterns[i].regex) != 0)) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+void patset_profile_report(pattern_set* set, int id, FILE* out) {
+	pattern* p = &set->patterns[id];
+	
+	if (p->fixed != NULL) {
+		fprintf(out, "  a fixed string, found without backtracking\n");
+	} else if (p->fellBack > 0) {
+		fprintf(out, "  went over the backtracking budget, so matched by the automaton since\n");
+	} else if (p->program != NULL) {
+		fprintf(out, "  matched by the automaton, without backtracking\n");
+	} else if (set->errors > 0) {
+		fprintf(out, "  matched with errors, without backtracking\n");
+	} else {
+		re_profile_report(p->regex, out);
+	}
+}
+
+void patset_free(pattern_set* set) {
+	int i;
+	
+	if (set != NULL) {
+		for (i = 0; i < set->count; i++) {
+			/* a pattern that has gone over the budget has both a regex and a program */
+			if (set->patterns[i].regex != NULL) {
+				re_free(set->patterns[i].regex);
+			}
+			
+			if (set->patterns[i].program != NULL) {
+				nfa_free(set->patterns[i].program);
+			}
+			
+			free(set->patterns[i].fixed);
+			free(set->patterns[i].source);
+		}
+		
+		free(set->patterns);
+		free(set->seen);
+		free(set);
+	}
+}
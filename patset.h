@@ -0,0 +1,118 @@
+/*
+ * Sets of regular expressions matched together.
+ *
+ * Every pattern in a set is tried against each line in a single pass: the line is
+ * scanned once for the literal text that each pattern requires, and only the patterns
+ * whose literal turns up (or that have none) are run, so a large set costs little more
+ * than a small one on lines that hold nothing of interest.
+ */
+
+#ifndef _GSGREP_PATSET_H
+#define _GSGREP_PATSET_H
+
+#include <stdio.h>
+#include "re.h"
+#include "nfa.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct pattern_set pattern_set;
+
+
+/* Create an empty set, or return NULL if there is not enough memory. */
+pattern_set* patset_new(void);
+
+
+/* Allow up to errors insertions, deletions and substitutions in the matches of the
+   patterns added to the set from now on (see re_find_approx). */
+void patset_set_errors(pattern_set* set, int errors);
+
+
+/* Require the matches of the patterns added to the set from now on to be whole words or
+   lines, with flags of RE_WORD or RE_LINE as for re_compile_flags. */
+void patset_set_flags(pattern_set* set, int flags);
+
+
+/* Limit the backtracking each regular expression of the set may do on a line to steps
+   (see re_set_budget), or set no limit if steps is 0.  A pattern that goes over the
+   limit is compiled again for the automaton of nfa.c, which matches it in time that
+   grows only with the length of the line, and is matched that way from then on, so the
+   matches found are the same, just without the time lost backtracking.  Setting the
+   budget afresh puts the patterns that went over the last one back to backtracking,
+   so that each search of a set kept between searches starts anew. */
+void patset_set_budget(pattern_set* set, long steps);
+
+
+/* Returns the number of patterns of the set that have gone over the budget. */
+int patset_fallbacks(pattern_set* set);
+
+
+/* Returns 0 if the pattern with the given id hasn't gone over the budget, or else the
+   order in which it did so, from 1 (so that those since the last call to
+   patset_fallbacks can be told apart). */
+int patset_fell_back(pattern_set* set, int id);
+
+
+/* Compile pattern and add it to the set, returning its id (the number of patterns added
+   before it), -1 if it would not compile or there is not enough memory, or -2 if
+   errors are allowed and the pattern can't be matched with them. */
+int patset_add(pattern_set* set, const char* pattern);
+
+
+/* Add text to the set as a fixed string, matched as it stands with no characters
+   taken as special, returning its id as patset_add does.  Fixed strings can't be
+   matched with errors. */
+int patset_add_fixed(pattern_set* set, const char* text);
+
+
+/* Returns the number of patterns in the set. */
+int patset_count(pattern_set* set);
+
+
+/* Match every pattern of the set against text.  If hits is not NULL, hits[id] is set
+   to 1 for each pattern that matches and 0 for each that doesn't, and the number of
+   patterns that match is returned.  If hits is NULL, returns 1 as soon as any pattern
+   matches, or 0 if none does. */
+int patset_match(pattern_set* set, const char* text, unsigned char* hits);
+
+
+/* Find the next match of any pattern of the set inside text, as re_find_next does for
+   a single pattern.  Where patterns match at the same place, the longest match is
+   taken. */
+int patset_find_next(pattern_set* set, const char* text, int* offset, int* matchlength);
+
+
+/* Find the groups of the match that the last call to patset_find_next found in text,
+   as nfa_submatches does; spans must have room for NFA_MAX_GROUPS groups.  Returns the
+   number of groups in the pattern that matched, which is 0 if it has none. */
+int patset_submatches(pattern_set* set, const char* text, int* spans);
+
+
+/* Copy the literal that every match must contain into literal, as re_literal does.
+   Only a set of one pattern has such a literal; otherwise 0 is returned. */
+int patset_literal(pattern_set* set, char* literal, int size);
+
+
+/* Start profiling each pattern of the set that is matched by backtracking (see
+   re_profile_start), returning 0, or -1 if there is not enough memory. */
+int patset_profile_start(pattern_set* set);
+
+
+/* Write the profile of the pattern with the given id to out, as re_profile_report
+   does, or say how it is matched instead if it isn't backtracked over. */
+void patset_profile_report(pattern_set* set, int id, FILE* out);
+
+
+/* Release a set and the patterns in it. */
+void patset_free(pattern_set* set);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_PATSET_H */
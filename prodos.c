@@ -0,0 +1,489 @@
+/*
+ * Read-only access to ProDOS disk images.
+ *
+ * The layout of the volume, directory and index blocks follows the ProDOS 8
+ * Technical Reference Manual (appendix B), with the extended (forked) files of
+ * GS/OS and the GS/OS lower case flags from ProDOS 8 Technical Note #25.
+ */
+
+#include "prodos.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+/* Storage types, from the high nibble of the first byte of a directory entry. */
+enum { DELETED = 0x0, SEEDLING = 0x1, SAPLING = 0x2, TREE = 0x3, PASCAL_AREA = 0x4,
+	   EXTENDED = 0x5, SUBDIRECTORY = 0xD, SUBDIRECTORY_HEADER = 0xE, VOLUME_HEADER = 0xF };
+
+#define VOLUME_DIRECTORY_BLOCK 2
+#define MAX_DIRECTORY_DEPTH    32
+#define MAX_PATH_LEN           256
+
+#define TWO_IMG_HEADER_LEN     64
+#define TWO_IMG_DOS_ORDER      0
+#define TWO_IMG_PRODOS_ORDER   1
+
+struct prodos_image {
+	FILE*         fp;            /* NULL for an image held in memory               */
+	const unsigned char* memory;
+	long          dataOffset;    /* offset of block 0 within the file              */
+	int           dosOrder;      /* a 2IMG image holding 16 sector tracks in DOS order */
+	unsigned int  totalBlocks;
+};
+
+struct prodos_file {
+	prodos_image* image;
+	int           storageType;
+	unsigned int  keyPointer;
+	long          eof;
+	long          position;
+	long          dataNumber;    /* the file block held in data, or -1              */
+	int           indexNumber;   /* the index block of a tree held in index, or -1  */
+	unsigned char master[PRODOS_BLOCK_SIZE];
+	unsigned char index[PRODOS_BLOCK_SIZE];
+	unsigned char data[PRODOS_BLOCK_SIZE];
+};
+
+typedef struct {
+	prodos_image*  image;
+	prodos_visitor visit;
+	void*          context;
+	char           path[MAX_PATH_LEN];
+	unsigned int   blocksRead;   /* guards against directories that link in a loop */
+} walker;
+
+/* The DOS 3.3 sector holding each half of the blocks of a track, for images in DOS order. */
+static const int dosSectors[16] = { 0, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 15 };
+
+
+
+/* Private functions: */
+static unsigned int get16(const unsigned char* p) {
+	return p[0] | ((unsigned int) p[1] << 8);
+}
+
+static long get24(const unsigned char* p) {
+	return p[0] | ((long) p[1] << 8) | ((long) p[2] << 16);
+}
+
+static long get32(const unsigned char* p) {
+	return get24(p) | ((long) p[3] << 24);
+}
+
+static int hasExtension(const char* path, const char* ext) {
+	size_t pathLen = strlen(path);
+	size_t extLen = strlen(ext);
+	size_t i;
+	
+	if (pathLen <= extLen) {
+		return 0;
+	}
+	
+	path += pathLen - extLen;
+	
+	for (i = 0; i < extLen; i++) {
+		if (tolower((unsigned char) path[i]) != ext[i]) {
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/* Read len bytes at offset (from block 0) of the image into buf. */
+static int readImage(prodos_image* image, long offset, unsigned char* buf, int len) {
+	if (image->memory != NULL) {
+		memcpy(buf, &image->memory[offset], len);
+		return 0;
+	}
+	
+	if (fseek(image->fp, image->dataOffset + offset, SEEK_SET) != 0) {
+		return -1;
+	}
+	
+	return (fread(buf, 1, len, image->fp) == (size_t) len) ? 0 : -1;
+}
+
+/* Read a block of the image into buf.  Block 0 is used in index blocks to mark a
+   sparse block, so it reads as all zeros. */
+static int readBlock(prodos_image* image, unsigned int block, unsigned char* buf) {
+	if (block == 0) {
+		memset(buf, 0, PRODOS_BLOCK_SIZE);
+		return 0;
+	}
+	
+	if (block >= image->totalBlocks) {
+		return -1;
+	}
+	
+	if (!image->dosOrder) {
+		return readImage(image, (long) block * PRODOS_BLOCK_SIZE, buf, PRODOS_BLOCK_SIZE);
+	} else {
+		long track = (long) (block >> 3) * 16;
+		int half;
+		
+		for (half = 0; half < 2; half++) {
+			long sector = track + dosSectors[((block & 7) << 1) + half];
+			
+			if (readImage(image, sector * 256, &buf[half * 256], 256) != 0) {
+				return -1;
+			}
+		}
+		
+		return 0;
+	}
+}
+
+/* Set the number of blocks in an image from the length of its data, and check that
+   the volume directory starts with a volume header and no previous block. */
+static int checkVolume(prodos_image* image, long dataLength) {
+	unsigned char buf[PRODOS_BLOCK_SIZE];
+	
+	dataLength /= PRODOS_BLOCK_SIZE;
+	image->totalBlocks = (dataLength > 0xFFFFL) ? 0xFFFF : (unsigned int) dataLength;
+	
+	return (readBlock(image, VOLUME_DIRECTORY_BLOCK, buf) == 0) &&
+		(get16(buf) == 0) &&
+		((buf[4] >> 4) == VOLUME_HEADER);
+}
+
+static void entryName(const unsigned char* e, char* name) {
+	int len = e[0] & 0x0F;
+	unsigned int caseFlags = get16(&e[0x1C]);
+	int i;
+	
+	for (i = 0; i < len; i++) {
+		name[i] = (char) e[1 + i];
+		
+		/* GS/OS keeps lower case flags in the version fields, one bit per character */
+		if (((caseFlags & 0x8000) != 0) && ((caseFlags & (0x4000 >> i)) != 0)) {
+			name[i] = (char) tolower((unsigned char) name[i]);
+		}
+	}
+	
+	name[len] = '\0';
+}
+
+static int walkDirectory(walker* w, unsigned int keyBlock, int depth) {
+	unsigned char* buf;
+	unsigned int block = keyBlock;
+	int entryLength, entriesPerBlock, idx = 1, result = 0;
+	size_t pathLen = strlen(w->path);
+	
+	if (depth > MAX_DIRECTORY_DEPTH) {
+		return -1;
+	}
+	
+	if ((buf = (unsigned char*) malloc(PRODOS_BLOCK_SIZE)) == NULL) {
+		return -1;
+	}
+	
+	if (readBlock(w->image, block, buf) != 0) {
+		free(buf);
+		return -1;
+	}
+	
+	/* the header entry of the key block says how the entries are laid out */
+	entryLength = buf[4 + 0x1F];
+	entriesPerBlock = buf[4 + 0x20];
+	
+	if ((entryLength < 0x27) || (entriesPerBlock == 0) ||
+		(4 + entryLength * entriesPerBlock > PRODOS_BLOCK_SIZE)) {
+		free(buf);
+		return -1;
+	}
+	
+	while (result == 0) {
+		for (; (result == 0) && (idx < entriesPerBlock); idx++) {
+			const unsigned char* e = &buf[4 + idx * entryLength];
+			int storageType = e[0] >> 4;
+			prodos_entry entry;
+			
+			if ((storageType == DELETED) || ((e[0] & 0x0F) == 0)) {
+				continue;
+			}
+			
+			entryName(e, entry.name);
+			entry.storageType = storageType;
+			entry.fileType = e[0x10];
+			entry.keyPointer = get16(&e[0x11]);
+			entry.eof = get24(&e[0x15]);
+			entry.auxType = get16(&e[0x1F]);
+			
+			if (pathLen + strlen(entry.name) + 2 > MAX_PATH_LEN) {
+				continue;
+			}
+			
+			strcpy(&w->path[pathLen], entry.name);
+			
+			if (storageType == SUBDIRECTORY) {
+				strcat(w->path, "/");
+				result = walkDirectory(w, entry.keyPointer, depth + 1);
+			} else if ((storageType == SEEDLING) || (storageType == SAPLING) ||
+					 (storageType == TREE) || (storageType == EXTENDED)) {
+				result = w->visit(w->context, w->path, &entry);
+			}
+			
+			w->path[pathLen] = '\0';
+		}
+		
+		block = get16(&buf[2]);
+		
+		if ((result != 0) || (block == 0)) {
+			break;
+		}
+		
+		if ((++w->blocksRead > w->image->totalBlocks) || (readBlock(w->image, block, buf) != 0)) {
+			result = -1;
+			break;
+		}
+		
+		idx = 0;
+	}
+	
+	free(buf);
+	return result;
+}
+
+/* Map a block of the file to the block of the image that holds it. */
+static long fileBlock(prodos_file* file, long number) {
+	int indexNumber;
+	unsigned int indexBlock;
+	
+	switch (file->storageType) {
+	case SEEDLING:
+		return (number == 0) ? file->keyPointer : 0;
+	
+	case SAPLING:
+		if (number > 255) {
+			return 0;
+		}
+		
+		return file->index[number] | ((unsigned int) file->index[256 + number] << 8);
+	
+	case TREE:
+		indexNumber = (int) (number >> 8);
+		
+		if (indexNumber > 127) {
+			return 0;
+		}
+		
+		if (indexNumber != file->indexNumber) {
+			indexBlock = file->master[indexNumber] | ((unsigned int) file->master[256 + indexNumber] << 8);
+			
+			if (readBlock(file->image, indexBlock, file->index) != 0) {
+				return -1;
+			}
+			
+			file->indexNumber = indexNumber;
+		}
+		
+		number &= 0xFF;
+		return file->index[number] | ((unsigned int) file->index[256 + number] << 8);
+	}
+	
+	return -1;
+}
+
+
+
+/* Public functions: */
+int prodos_is_image_name(const char* path) {
+	return hasExtension(path, ".po") || hasExtension(path, ".hdv") || hasExtension(path, ".2mg");
+}
+
+prodos_image* prodos_open(const char* path) {
+	prodos_image* image;
+	unsigned char buf[PRODOS_BLOCK_SIZE];
+	long dataLength;
+	
+	if ((image = (prodos_image*) malloc(sizeof(prodos_image))) == NULL) {
+		return NULL;
+	}
+	
+	if ((image->fp = fopen(path, "rb")) == NULL) {
+		free(image);
+		return NULL;
+	}
+	
+	image->memory = NULL;
+	image->dataOffset = 0;
+	image->dosOrder = 0;
+	
+	fseek(image->fp, 0, SEEK_END);
+	dataLength = ftell(image->fp);
+	fseek(image->fp, 0, SEEK_SET);
+	
+	/* a 2IMG image starts with a header giving the format and where the data is */
+	if ((fread(buf, 1, TWO_IMG_HEADER_LEN, image->fp) == TWO_IMG_HEADER_LEN) &&
+		(memcmp(buf, "2IMG", 4) == 0)) {
+		long format = get32(&buf[0x0C]);
+		
+		if ((format != TWO_IMG_PRODOS_ORDER) && (format != TWO_IMG_DOS_ORDER)) {
+			prodos_close(image);
+			return NULL;
+		}
+		
+		image->dosOrder = (format == TWO_IMG_DOS_ORDER);
+		image->dataOffset = get32(&buf[0x18]);
+		
+		if (get32(&buf[0x1C]) < dataLength - image->dataOffset) {
+			dataLength = get32(&buf[0x1C]) + image->dataOffset;
+		}
+	}
+	
+	if (!checkVolume(image, dataLength - image->dataOffset)) {
+		prodos_close(image);
+		return NULL;
+	}
+	
+	return image;
+}
+
+prodos_image* prodos_open_memory(const unsigned char* data, long length) {
+	prodos_image* image;
+	
+	if ((image = (prodos_image*) malloc(sizeof(prodos_image))) == NULL) {
+		return NULL;
+	}
+	
+	image->fp = NULL;
+	image->memory = data;
+	image->dataOffset = 0;
+	image->dosOrder = 0;
+	
+	if (!checkVolume(image, length)) {
+		free(image);
+		return NULL;
+	}
+	
+	return image;
+}
+
+void prodos_close(prodos_image* image) {
+	if (image != NULL) {
+		if (image->fp != NULL) {
+			fclose(image->fp);
+		}
+		
+		free(image);
+	}
+}
+
+int prodos_walk(prodos_image* image, prodos_visitor visit, void* context) {
+	walker* w;
+	int result;
+	
+	if ((w = (walker*) malloc(sizeof(walker))) == NULL) {
+		return -1;
+	}
+	
+	w->image = image;
+	w->visit = visit;
+	w->context = context;
+	w->path[0] = '\0';
+	w->blocksRead = 0;
+	
+	result = walkDirectory(w, VOLUME_DIRECTORY_BLOCK, 0);
+	
+	free(w);
+	return result;
+}
+
+prodos_file* prodos_file_open(prodos_image* image, const prodos_entry* entry) {
+	prodos_file* file;
+	
+	if ((file = (prodos_file*) malloc(sizeof(prodos_file))) == NULL) {
+		return NULL;
+	}
+	
+	file->image = image;
+	file->storageType = entry->storageType;
+	file->keyPointer = entry->keyPointer;
+	file->eof = entry->eof;
+	file->position = 0;
+	file->dataNumber = -1;
+	file->indexNumber = -1;
+	
+	/* an extended file's key block holds a mini entry for each fork; the data fork's
+	   comes first, and the resource fork is never read. */
+	if (file->storageType == EXTENDED) {
+		if (readBlock(image, file->keyPointer, file->data) != 0) {
+			free(file);
+			return NULL;
+		}
+		
+		file->storageType = file->data[0] & 0x0F;
+		file->keyPointer = get16(&file->data[1]);
+		file->eof = get24(&file->data[5]);
+	}
+	
+	switch (file->storageType) {
+	case SEEDLING:
+		break;
+	
+	case SAPLING:
+		if (readBlock(image, file->keyPointer, file->index) != 0) {
+			free(file);
+			return NULL;
+		}
+		break;
+	
+	case TREE:
+		if (readBlock(image, file->keyPointer, file->master) != 0) {
+			free(file);
+			return NULL;
+		}
+		break;
+	
+	default:
+		free(file);
+		return NULL;
+	}
+	
+	return file;
+}
+
+long prodos_file_read(prodos_file* file, char* buf, long len) {
+	long done = 0;
+	
+	while ((done < len) && (file->position < file->eof)) {
+		long number = file->position / PRODOS_BLOCK_SIZE;
+		int offset = (int) (file->position % PRODOS_BLOCK_SIZE);
+		long chunk = PRODOS_BLOCK_SIZE - offset;
+		
+		if (number != file->dataNumber) {
+			long block = fileBlock(file, number);
+			
+			if ((block < 0) || (readBlock(file->image, (unsigned int) block, file->data) != 0)) {
+				return -1;
+			}
+			
+			file->dataNumber = number;
+		}
+		
+		if (chunk > file->eof - file->position) {
+			chunk = file->eof - file->position;
+		}
+		
+		if (chunk > len - done) {
+			chunk = len - done;
+		}
+		
+		memcpy(&buf[done], &file->data[offset], chunk);
+		done += chunk;
+		file->position += chunk;
+	}
+	
+	return done;
+}
+
+void prodos_file_close(prodos_file* file) {
+	free(file);
+}
@@ -0,0 +1,85 @@
+/*
+ * Read-only access to ProDOS disk images.
+ *
+ * An image (.po, .hdv or .2mg) is opened as a virtual directory tree: the volume
+ * directory and its subdirectories are walked in place, and each file is streamed a
+ * block at a time through its index blocks, so nothing is ever extracted to disk.
+ */
+
+#ifndef _GSGREP_PRODOS_H
+#define _GSGREP_PRODOS_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+#define PRODOS_BLOCK_SIZE 512
+
+
+/* Typedef'd pointers to get abstract datatypes. */
+typedef struct prodos_image prodos_image;
+typedef struct prodos_file prodos_file;
+
+
+/* A file found while walking an image. */
+typedef struct prodos_entry
+{
+	char          name[16];      /* nul terminated, with any GS/OS lower case applied */
+	int           storageType;   /* seedling, sapling, tree or extended               */
+	int           fileType;
+	unsigned int  auxType;
+	unsigned int  keyPointer;
+	long          eof;           /* length of the data fork                           */
+} prodos_entry;
+
+
+/* Called for each file in an image, with its path relative to the volume directory
+   (e.g. "SUBDIR/FILE").  Return 0 to carry on walking, anything else to stop. */
+typedef int (*prodos_visitor)(void* context, const char* path, const prodos_entry* entry);
+
+
+/* Returns non-zero if path has the extension of a disk image (.po, .hdv or .2mg). */
+int prodos_is_image_name(const char* path);
+
+
+/* Open the disk image at path, returning NULL if it can't be read or doesn't hold a
+   ProDOS volume. */
+prodos_image* prodos_open(const char* path);
+
+
+/* Open an image of length bytes already held in memory, in ProDOS block order, such
+   as a disk unpacked from an archive.  The data is not copied, so it must outlive the
+   image.  Returns NULL if it doesn't hold a ProDOS volume. */
+prodos_image* prodos_open_memory(const unsigned char* data, long length);
+
+
+/* Close an image opened with prodos_open or prodos_open_memory. */
+void prodos_close(prodos_image* image);
+
+
+/* Walk every directory of the image, calling visit for each file (directories are
+   not passed to it).  Returns 0 once the walk is complete, -1 if a directory block
+   could not be read, or the non-zero value returned by visit to stop the walk. */
+int prodos_walk(prodos_image* image, prodos_visitor visit, void* context);
+
+
+/* Open the data fork of a file found by prodos_walk, for streaming with
+   prodos_file_read.  Returns NULL if the file's storage type is not understood. */
+prodos_file* prodos_file_open(prodos_image* image, const prodos_entry* entry);
+
+
+/* Read up to len bytes from the file into buf, returning the number of bytes read,
+   0 at the end of the file, or -1 if a block of the image could not be read. */
+long prodos_file_read(prodos_file* file, char* buf, long len);
+
+
+/* Close a file opened with prodos_file_open. */
+void prodos_file_close(prodos_file* file);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_PRODOS_H */
@@ -0,0 +1,228 @@
+/*
+ * Progress reports and cancelling a search, for gsgrep.
+ *
+ * The time is only looked at once per block, and anything else is only done once
+ * enough of it has passed, so that a search of many short lines costs no more than one
+ * of a few long ones.
+ */
+
+#include "progress.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#include <gsos.h>
+#include <shell.h>
+#endif
+
+/* the time between turns of the spinner, and between reports, in milliseconds. */
+#define SPIN_INTERVAL 100
+#define REPORT_INTERVAL 250
+
+/* the most of the name of the file being searched that a report shows. */
+#define MAX_NAME 40
+
+static int progressOptions = 0;
+static volatile sig_atomic_t stopped = 0;
+
+static long started;
+static long lastTick;
+static long searched;
+static long expected;
+static int expectKnown;
+static long files;
+static char current[MAX_NAME + 1];
+static int shown = 0;            /* the length of the report on the screen       */
+
+#ifdef __ORCAC__
+static const char SPINNER[] = "-\\|/";
+static int spinnerIdx = 0;
+#endif
+
+
+
+/* Private functions: */
+
+/* Returns the time in milliseconds, from some fixed point. */
+static long now(void) {
+	#ifdef __ORCAC__
+	return (long) (clock() * 1000L / CLOCKS_PER_SEC);
+	#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long) ts.tv_sec * 1000L + (long) (ts.tv_nsec / 1000000L);
+	#endif
+}
+
+#ifdef __ORCAC__
+
+/* Turns the spinner, and asks the shell whether Command-period has been pressed. */
+static void spin(void) {
+	StopGSPB stopParm;
+	ConsoleOutGSPB consoleOutParm;
+	
+	consoleOutParm.pCount = 1;
+	consoleOutParm.ch = SPINNER[spinnerIdx++];
+	ConsoleOutGS(&consoleOutParm);
+	consoleOutParm.ch = 010;
+	ConsoleOutGS(&consoleOutParm);
+	
+	if (spinnerIdx > 3) {
+		spinnerIdx = 0;
+	}
+	
+	stopParm.pCount = 1;
+	stopParm.flag = 0;
+	StopGS(&stopParm);
+	
+	if (stopParm.flag != 0) {
+		stopped = 1;
+	}
+}
+
+#else
+
+/* The first interrupt stops the search; the next is left to end the program. */
+static void interrupted(int sig) {
+	(void) sig;
+	
+	stopped = 1;
+	signal(SIGINT, SIG_DFL);
+}
+
+#endif
+
+static int formatBytes(char* buf, long bytes) {
+	if (bytes < 10240L) {
+		return sprintf(buf, "%ld bytes", bytes);
+	} else if (bytes < 10485760L) {
+		return sprintf(buf, "%ldK", bytes / 1024L);
+	}
+	
+	return sprintf(buf, "%ldM", bytes / 1048576L);
+}
+
+/* Writes a report over the last one. */
+static void report(long time) {
+	char line[MAX_NAME + 100];
+	long elapsed = time - started, rate;
+	int len;
+	
+	rate = (elapsed > 0) ? (long) ((double) searched * 1000.0 / (double) elapsed) : 0;
+	
+	len = sprintf(line, "%ld file%s, ", files, (files == 1) ? "" : "s");
+	len += formatBytes(line + len, searched);
+	len += sprintf(line + len, " at ");
+	len += formatBytes(line + len, rate);
+	len += sprintf(line + len, "/s");
+	
+	if (expectKnown && (rate > 0) && (expected > searched)) {
+		len += sprintf(line + len, ", %lds left", (expected - searched) / rate + 1);
+	}
+	
+	len += sprintf(line + len, ": %s", current);
+	
+	fprintf(stderr, "\r%s%*s", line, (shown > len) ? shown - len : 0, "");
+	fflush(stderr);
+	shown = len;
+}
+
+
+
+/* Public functions: */
+
+void progress_start(int options) {
+	progressOptions = options;
+	stopped = 0;
+	started = lastTick = now();
+	searched = expected = files = 0;
+	expectKnown = 1;
+	current[0] = '\0';
+	shown = 0;
+	
+	#ifndef __ORCAC__
+	if ((options & PROGRESS_CANCEL) != 0) {
+		signal(SIGINT, interrupted);
+	}
+	#endif
+}
+
+void progress_expect(long bytes) {
+	if (bytes < 0) {
+		expectKnown = 0;
+	} else {
+		expected += bytes;
+	}
+}
+
+void progress_file(const char* name) {
+	size_t len = strlen(name);
+	
+	files++;
+	
+	// a long name is cut down to its end, which is the part that tells files apart.
+	//
+	strcpy(current, (len > MAX_NAME) ? name + len - MAX_NAME : name);
+}
+
+int progress_update(long bytes) {
+	long time;
+	
+	searched += bytes;
+	
+	if (stopped || (progressOptions == 0)) {
+		return stopped;
+	}
+	
+	// away from the IIGS, an interrupt stops the search without having to be looked for.
+	//
+	#ifndef __ORCAC__
+	if ((progressOptions & PROGRESS_REPORT) == 0) {
+		return stopped;
+	}
+	#endif
+	
+	time = now();
+	
+	if (time - lastTick >=
+		(((progressOptions & PROGRESS_REPORT) != 0) ? REPORT_INTERVAL : SPIN_INTERVAL)) {
+		lastTick = time;
+		
+		#ifdef __ORCAC__
+		if ((progressOptions & PROGRESS_CANCEL) != 0) {
+			spin();
+		}
+		#endif
+		
+		if ((progressOptions & PROGRESS_REPORT) != 0) {
+			report(time);
+		}
+	}
+	
+	return stopped;
+}
+
+int progress_stopped(void) {
+	return stopped;
+}
+
+void progress_finish(void) {
+	if (shown > 0) {
+		fprintf(stderr, "\r%*s\r", shown, "");
+		fflush(stderr);
+		shown = 0;
+	}
+	
+	#ifndef __ORCAC__
+	if ((progressOptions & PROGRESS_CANCEL) != 0) {
+		signal(SIGINT, SIG_DFL);
+	}
+	#endif
+	
+	progressOptions = 0;
+}
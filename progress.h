@@ -0,0 +1,58 @@
+/*
+ * Progress reports and cancelling a search, for gsgrep.
+ *
+ * The search tells this module how far it has got once per block that it reads, and
+ * is told whether the user has asked for it to stop.  The module does no more than
+ * look at a flag for most blocks; only once enough time has passed since it last did
+ * so does it turn the spinner on the IIGS (and ask the shell whether Command-period
+ * has been pressed) or write out a report of the progress made.  Elsewhere an
+ * interrupt (Control-C) stops the search at the end of the block it is in, so that the
+ * output so far is written out whole; a second one ends the program outright.
+ */
+
+#ifndef _GSGREP_PROGRESS_H
+#define _GSGREP_PROGRESS_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Options for progress_start: stop the search when it is interrupted (or, on the IIGS,
+   turn the spinner and check for Command-period), and report the bytes and files
+   searched, how fast and, if it can be worked out, how long is left, on stderr. */
+#define PROGRESS_CANCEL  1
+#define PROGRESS_REPORT  2
+
+
+/* Start keeping track of a search, with the options above. */
+void progress_start(int options);
+
+
+/* Add bytes to the total that the search is expected to read, from which the time left
+   is worked out.  If bytes is negative, the total can't be known. */
+void progress_expect(long bytes);
+
+
+/* Note that the search of the file (or other input) called name is starting. */
+void progress_file(const char* name);
+
+
+/* Note that bytes more have been searched, returning non-zero if the search should
+   stop. */
+int progress_update(long bytes);
+
+
+/* Returns non-zero if the user has asked for the search to stop. */
+int progress_stopped(void);
+
+
+/* Finish keeping track of the search, clearing away the last report and the spinner. */
+void progress_finish(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_PROGRESS_H */
@@ -23,24 +23,55 @@
 *   '\W'       Non-alphanumeric
 *   '\d'       Digits, [0-9]
 *   '\D'       Non-digits
+*   '\b'       Word boundary, between a word character and a non-word character
+*   '\B'       Not a word boundary
 *
 *
+* Patterns made only of symbols that each match a single character (with at most a
+* '$' at the end) are matched bit-parallel, one bit of a machine word per symbol,
+* rather than by backtracking: with the shift-and algorithm for the shortest, and
+* otherwise with BNDM, which reads each window of the text backwards and skips ahead
+* past as much of it as cannot start a match.  The same tables drive re_find_approx,
+* which allows a number of errors in the match with the Wu-Manber extension of
+* shift-and.
+*
 */
 
 
 
 #include "re.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 /* Definitions: */
 
 #define MAX_REGEXP_OBJECTS      30    /* Max number of regex symbols in expression. */
 #define MAX_CHAR_CLASS_LEN      40    /* Max length of character-class buffer in.   */
+#define MIN_BNDM_LEN            4     /* Shorter patterns gain nothing from skipping. */
+#define PROFILE_WORST           4     /* Costliest abandoned starts a profile keeps.  */
+#define PROFILE_EXCERPT         32    /* Characters of the text shown for each.       */
 
 //#define DEBUG 0
 
-enum { UNUSED, DOT, BEGIN, END, QUESTIONMARK, STAR, PLUS, CHAR, CHAR_CLASS, INV_CHAR_CLASS, DIGIT, NOT_DIGIT, ALPHA, NOT_ALPHA, WHITESPACE, NOT_WHITESPACE /*, BRANCH */ };
+enum { UNUSED, DOT, BEGIN, END, QUESTIONMARK, STAR, PLUS, CHAR, CHAR_CLASS, INV_CHAR_CLASS, DIGIT, NOT_DIGIT, ALPHA, NOT_ALPHA, WHITESPACE, NOT_WHITESPACE, WORD_BOUNDARY, NOT_WORD_BOUNDARY, WORD_START, WORD_END /*, BRANCH */ };
+
+/* WORD_START and WORD_END are the edges of a whole word (with no word character before
+   or after them) that RE_WORD puts around a pattern; neither reads a character. */
+
+/* Tables for matching a pattern bit-parallel, one bit per symbol. */
+typedef struct bitparallel_t
+{
+	unsigned long  masks[256];  /* bit i set if symbol i matches the character */
+	int            length;      /* the number of symbols                        */
+	int            atStart;     /* the pattern starts with '^'                  */
+	int            atEnd;       /* the pattern ends with '$'                    */
+	int            wordStart;   /* a match must start a word, as with RE_WORD   */
+	int            wordEnd;     /* a match must end a word                      */
+} bitparallel_t;
 
 typedef struct regex_t
 {
@@ -49,9 +80,34 @@ typedef struct regex_t
 	{
 		unsigned char  ch;   /*      the character itself             */
 		unsigned char* ccl;  /*  OR  a pointer to characters in class */
+		bitparallel_t* bp;   /*  OR  in the UNUSED sentinel, the bit-parallel tables if any */
 	} u;
 } regex_t;
 
+/* A start of a match that was abandoned, for a profile. */
+typedef struct abandoned_t
+{
+	long           steps;       /* the symbols tried and characters given back */
+	int            offset;      /* where in its line it was                    */
+	char           text[PROFILE_EXCERPT + 1];
+} abandoned_t;
+
+/* The work the backtracking matcher has done on a pattern, for re_profile_start. */
+typedef struct profile_t
+{
+	regex_t*          pattern;
+	long              tried[MAX_REGEXP_OBJECTS];      /* times each symbol was tried against a character */
+	long              backtracked[MAX_REGEXP_OBJECTS]; /* times the rest failed after each '*', '+' and '?' */
+	long              stopped[MAX_REGEXP_OBJECTS];    /* abandoned starts that got no further than each */
+	long              starts;
+	long              abandoned;
+	long              steps;       /* of the start being tried     */
+	int               deepest;     /* the furthest symbol it has reached */
+	abandoned_t       worst[PROFILE_WORST];            /* costliest first */
+	int               worstCount;
+	struct profile_t* next;
+} profile_t;
+
 
 
 /* Private function declarations: */
@@ -67,30 +123,144 @@ static int matchmetachar(char c, const char* str);
 static int matchrange(char c, const char* str);
 static int matchdot(char c);
 static int ismetachar(char c);
+static bitparallel_t* compilebitparallel(regex_t* pattern);
+static bitparallel_t* getbitparallel(regex_t* pattern);
+static int findbitparallel(bitparallel_t* bp, const char* text, int* matchlength);
+static int isassertion(regex_t* pattern);
+static int matchassertion(unsigned char type, const char* text);
+static profile_t* findprofile(regex_t* pattern);
+static void dropprofile(profile_t* profile);
+static void startattempt(void);
+static void abandonattempt(const char* text, int offset);
+static int countsymbol(regex_t* p);
+static int countbacktrack(regex_t* p);
+static int describesymbol(regex_t* p, char* buf);
+
+
+/* The start of the text being searched, so that the assertions can look behind them. */
+static const char* linestart;
+
+/* The patterns being profiled, and the profile of the one being matched if it is one.
+   The matcher only calls on the profile while there is one, so that it costs no more
+   than a test of profiling when nothing is being counted. */
+static profile_t* profiles;
+static profile_t* profiling;
+
+/* The backtracking re_find_next may do on a line (see re_set_budget), and how much of
+   it the line being matched has left. */
+static long budget = 0;
+static long stepsleft;
+
+#define TRIED(p)       ((profiling == 0) || countsymbol(p))
+#define BACKTRACKED(p) ((profiling == 0) || countbacktrack(p))
+
+static const char* typenames[] = { "UNUSED", "DOT", "BEGIN", "END", "QUESTIONMARK", "STAR", "PLUS", "CHAR", "CHAR_CLASS", "INV_CHAR_CLASS", "DIGIT", "NOT_DIGIT", "ALPHA", "NOT_ALPHA", "WHITESPACE", "NOT_WHITESPACE", "WORD_BOUNDARY", "NOT_WORD_BOUNDARY", "WORD_START", "WORD_END", "BRANCH" };
 
 
 
 /* Public functions: */
 int re_match(const char* pattern, const char* text, int* matchlength)
 {
-	return re_matchp(re_compile(pattern), text, matchlength);
+	re_t compiled = re_compile(pattern);
+	int result = re_matchp(compiled, text, matchlength);
+	
+	re_free(compiled);
+	return result;
 }
 
 int re_matchp(re_t pattern, const char* text, int* matchlength)
+{
+	int offset = 0;
+	
+	return re_find_next(pattern, text, &offset, matchlength);
+}
+
+int re_find_next(re_t pattern, const char* text, int* offset, int* matchlength)
 {
 	*matchlength = 0;
-	if (pattern != 0)
+	linestart = text;
+	profiling = (profiles != 0) ? findprofile(pattern) : 0;
+	stepsleft = (budget > 0) ? budget : LONG_MAX;
+	if ((pattern != 0) && (*offset >= 0))
 	{
 		if (pattern[0].type == BEGIN)
 		{
 			#ifdef DEBUG
 			printf("pattern begins with ^ and text is <%s>\n", text);
 			#endif
-			return ((matchpattern(&pattern[1], text, matchlength)) ? 0 : -1);
+			/* an anchored pattern can only ever match once, at the start of the line */
+			if (*offset == 0)
+			{
+				if (profiling != 0)
+				{
+					startattempt();
+				}
+				
+				/* a match found after the budget ran out may not be the one that would
+				   have been found without it, so it is given up on too */
+				if (matchpattern(&pattern[1], text, matchlength) && (stepsleft >= 0))
+				{
+					*offset = (*matchlength > 0) ? *matchlength : -1;
+					return 0;
+				}
+				
+				if (profiling != 0)
+				{
+					abandonattempt(text, 0);
+				}
+				
+				if (stepsleft < 0)
+				{
+					*offset = -1;
+					return RE_OVER_BUDGET;
+				}
+			}
+			
+			*offset = -1;
+		}
+		else if (getbitparallel(pattern) != 0)
+		{
+			bitparallel_t* bp = getbitparallel(pattern);
+			int from = *offset;
+			int idx;
+			
+			for (;;)
+			{
+				idx = findbitparallel(bp, text + from, matchlength);
+				
+				if (idx < 0)
+				{
+					*offset = -1;
+					return -1;
+				}
+				
+				idx += from;
+				
+				/* every match is as long as the pattern, so one that isn't a whole word
+				   only rules out its own start, and the search carries on from the next */
+				if ((!bp->wordStart || matchassertion(WORD_START, text + idx)) &&
+					(!bp->wordEnd || matchassertion(WORD_END, text + idx + *matchlength)))
+				{
+					break;
+				}
+				
+				if (bp->atEnd)
+				{
+					*offset = -1;
+					return -1;
+				}
+				
+				from = idx + 1;
+			}
+			
+			*offset = idx + *matchlength;
+			return idx;
 		}
 		else
 		{
-			int idx = -1;
+			int idx = *offset - 1;
+			
+			text += *offset;
 			
 			#ifdef DEBUG
 			printf("no starting ^\n");
@@ -102,41 +272,286 @@ int re_matchp(re_t pattern, const char* text, int* matchlength)
 				#ifdef DEBUG
 				printf("does it match <%s>?\n", text);
 				#endif
-				if (matchpattern(pattern, text, matchlength))
+				if (profiling != 0)
+				{
+					startattempt();
+				}
+				
+				if (matchpattern(pattern, text, matchlength) && (stepsleft >= 0))
 				{
 					#ifdef DEBUG
 					printf("yes it does!\n");
 					#endif
 					
-					if (text[0] == '\0') {
-						#ifdef DEBUG
-						printf("but the string is empty? so no it doesn't\n");
-						#endif
-						return -1;
-					}
-					
+					/* resume after the match, stepping over empty matches so that the
+					   caller always makes progress.  an empty match at the end of the
+					   text is the last one it can have. */
+					*offset = (text[0] == '\0') ? -1 : idx + ((*matchlength > 0) ? *matchlength : 1);
 					return idx;
 				}
+				
+				if (profiling != 0)
+				{
+					abandonattempt(text, idx);
+				}
+				
+				if (stepsleft < 0)
+				{
+					*offset = -1;
+					return RE_OVER_BUDGET;
+				}
 			}
 			while (*text++ != '\0');
+			
+			*offset = -1;
 		}
 	}
 	return -1;
 }
 
+int re_can_approx(re_t pattern)
+{
+	bitparallel_t* bp = (pattern != 0) ? getbitparallel(pattern) : 0;
+	
+	return (bp != 0) && !bp->wordStart && !bp->wordEnd;
+}
+
+int re_find_approx(re_t pattern, int errors, const char* text, int* offset, int* matchlength)
+{
+	bitparallel_t* bp;
+	const unsigned char* t;
+	unsigned long r[RE_MAX_ERRORS + 1];
+	unsigned long mask, found, prev, next;
+	int cost[2][8 * sizeof(unsigned long) + 1];
+	int i, d, j, m, end = -1, begin, inserted, least = 0;
+	int *old, *now;
+	
+	*matchlength = 0;
+	if ((pattern == 0) || (*offset < 0) || ((bp = getbitparallel(pattern)) == 0) ||
+		(bp->atStart && (*offset > 0)) || (errors < 0) || (errors > RE_MAX_ERRORS))
+	{
+		*offset = -1;
+		return -1;
+	}
+	
+	t = (const unsigned char*) text + *offset;
+	m = bp->length;
+	found = 1UL << (m - 1);
+	
+	/* bit i of r[d] is set if the text read so far ends with a match of the first i+1
+	   symbols with at most d errors.  Before anything is read, that takes i+1 deletions.
+	   A match may begin before the next character with at most d errors if it is
+	   unanchored, or if d covers the characters read so far as insertions. */
+	for (d = 0; d <= errors; d++)
+	{
+		r[d] = (1UL << d) - 1;
+	}
+	
+	/* the first place a match can end is taken, unless it can be carried on with fewer
+	   errors by the characters that follow */
+	for (i = 0; ; i++)
+	{
+		if (((r[errors] & found) != 0) && (!bp->atEnd || (t[i] == '\0')))
+		{
+			for (d = 0; (r[d] & found) == 0; d++)
+			{
+			}
+			
+			if ((end < 0) || (d < least))
+			{
+				end = i;
+				least = d;
+			}
+		}
+		else if (end >= 0)
+		{
+			break;
+		}
+		
+		if ((t[i] == '\0') || ((end >= 0) && (least == 0)))
+		{
+			break;
+		}
+		
+		/* each row takes a matching character from its own row, and an inserted character,
+		   a substitution or a deletion from the row above it */
+		mask = bp->masks[t[i]];
+		inserted = bp->atStart ? i : 0;
+		prev = r[0];
+		r[0] = ((r[0] << 1) | (unsigned long) (inserted == 0)) & mask;
+		for (d = 1; d <= errors; d++)
+		{
+			next = r[d];
+			r[d] = (((next << 1) | (unsigned long) (inserted <= d)) & mask) | prev | (prev << 1) |
+				(unsigned long) (inserted <= d - 1) | (r[d - 1] << 1);
+			prev = next;
+		}
+	}
+	
+	if (end < 0)
+	{
+		*offset = -1;
+		return -1;
+	}
+	
+	/* the match ends at end: find where it starts by working out the edit distance from
+	   the end of the pattern back to each place it could start (it can't be longer than
+	   m + errors), taking the one with the fewest errors, and the nearest of those.  An
+	   empty match is only taken when there's nothing to read. */
+	begin = end;
+	if (!bp->atStart)
+	{
+		least = errors + 1;
+		
+		old = cost[0];
+		now = cost[1];
+		for (j = 0; j <= m; j++)
+		{
+			old[j] = j;
+		}
+		
+		for (i = end; (i > 0) && (i >= end - m - errors); i--)
+		{
+			now[0] = old[0] + 1;
+			for (j = 1; j <= m; j++)
+			{
+				int best = old[j - 1] + (((bp->masks[t[i - 1]] >> (m - j)) & 1) ? 0 : 1);
+				
+				if (old[j] + 1 < best)
+				{
+					best = old[j] + 1;
+				}
+				if (now[j - 1] + 1 < best)
+				{
+					best = now[j - 1] + 1;
+				}
+				now[j] = best;
+			}
+			
+			if (now[m] < least)
+			{
+				least = now[m];
+				begin = i - 1;
+			}
+			
+			old = now;
+			now = (now == cost[0]) ? cost[1] : cost[0];
+		}
+	}
+	else
+	{
+		begin = 0;
+	}
+	
+	/* like re_find_next, an empty match at the very end of the text doesn't count */
+	if ((begin == end) && (t[begin] == '\0'))
+	{
+		*offset = -1;
+		return -1;
+	}
+	
+	*matchlength = end - begin;
+	begin += *offset;
+	*offset = begin + ((*matchlength > 0) ? *matchlength : 1);
+	
+	return begin;
+}
+
+int re_literal(re_t pattern, char* literal, int size)
+{
+	int i = 0, run = 0, best = 0, bestStart = 0;
+	
+	if (pattern == 0)
+	{
+		return 0;
+	}
+	
+	if (pattern[0].type == BEGIN)
+	{
+		i = 1;
+	}
+	
+	for (; pattern[i].type != UNUSED; i++)
+	{
+		unsigned char next = pattern[i+1].type;
+		
+		/* a character is only required if it is not made optional by a following * or ? */
+		if ((pattern[i].type == CHAR) && (next != STAR) && (next != QUESTIONMARK))
+		{
+			run += 1;
+			if (run > best)
+			{
+				best = run;
+				bestStart = i + 1 - run;
+			}
+			
+			/* with a following +, the character may repeat, so the run stops here */
+			if (next == PLUS)
+			{
+				run = 0;
+			}
+		}
+		else
+		{
+			run = 0;
+		}
+	}
+	
+	if (best > size)
+	{
+		best = size;
+	}
+	
+	for (i = 0; i < best; i++)
+	{
+		literal[i] = pattern[bestStart + i].u.ch;
+	}
+	
+	return best;
+}
+
 re_t re_compile(const char* pattern)
 {
-	/* The sizes of the two static arrays below substantiates the static RAM usage of this module.
+	return re_compile_flags(pattern, 0);
+}
+
+re_t re_compile_flags(const char* pattern, int flags)
+{
+	/* The pattern is compiled into the two static arrays below, then copied into a block
+	of its own so that any number of compiled patterns can be held at once.
 	MAX_REGEXP_OBJECTS is the max number of symbols in the expression.
 	MAX_CHAR_CLASS_LEN determines the size of buffer for chars in all char-classes in the expression. */
 	static regex_t re_compiled[MAX_REGEXP_OBJECTS];
 	static unsigned char ccl_buf[MAX_CHAR_CLASS_LEN];
 	int ccl_bufidx = 1;
+	regex_t* copy;
+	unsigned char* copy_ccl;
 	
 	char c;     /* current char in pattern   */
 	int i = 0;  /* index into pattern        */
 	int j = 0;  /* index into re_compiled    */
 	
+	/* Nothing may be left over from the last pattern compiled: the matcher looks at the
+	character of symbols that carry none when it steps over a failed * or +. */
+	memset(re_compiled, 0, sizeof(re_compiled));
+	
+	/* A whole line starts at the beginning, and a whole word where no word character
+	comes before it (after any '^' of the pattern's own). */
+	if (pattern[0] == '^')
+	{
+		re_compiled[j++].type = BEGIN;
+		i += 1;
+	}
+	else if (flags & RE_LINE)
+	{
+		re_compiled[j++].type = BEGIN;
+	}
+	
+	if ((flags & RE_WORD) && !(flags & RE_LINE))
+	{
+		re_compiled[j++].type = WORD_START;
+	}
+	
 	while (pattern[i] != '\0' && (j+1 < MAX_REGEXP_OBJECTS))
 	{
 		c = pattern[i];
@@ -169,6 +584,8 @@ re_t re_compile(const char* pattern)
 					case 'W': {    re_compiled[j].type = NOT_ALPHA;        } break;
 					case 's': {    re_compiled[j].type = WHITESPACE;       } break;
 					case 'S': {    re_compiled[j].type = NOT_WHITESPACE;   } break;
+					case 'b': {    re_compiled[j].type = WORD_BOUNDARY;    } break;
+					case 'B': {    re_compiled[j].type = NOT_WORD_BOUNDARY; } break;
 						
 						/* Escaped character, e.g. '.' or '$' */
 					default:
@@ -260,47 +677,156 @@ re_t re_compile(const char* pattern)
 		i += 1;
 		j += 1;
 	}
+	
+	/* ... and ends at the end of the line, or where no word character follows it (before
+	any '$' of the pattern's own). */
+	if (flags & (RE_WORD | RE_LINE))
+	{
+		int atEnd = (j > 0) && (re_compiled[j-1].type == END);
+		
+		if (j + 2 >= MAX_REGEXP_OBJECTS)
+		{
+			return 0;
+		}
+		
+		if (flags & RE_LINE)
+		{
+			if (!atEnd)
+			{
+				re_compiled[j++].type = END;
+			}
+		}
+		else if (atEnd)
+		{
+			re_compiled[j-1].type = WORD_END;
+			re_compiled[j++].type = END;
+		}
+		else
+		{
+			re_compiled[j++].type = WORD_END;
+		}
+	}
+	
 	/* 'UNUSED' is a sentinel used to indicate end-of-pattern */
 	re_compiled[j].type = UNUSED;
+	re_compiled[j].u.bp = 0;
+	
+	/* The character classes follow the symbols in the copy, so move their pointers along. */
+	copy = (regex_t*) malloc((j + 1) * sizeof(regex_t) + ccl_bufidx);
+	if (copy == 0)
+	{
+		return 0;
+	}
+	
+	copy_ccl = (unsigned char*) &copy[j + 1];
+	memcpy(copy, re_compiled, (j + 1) * sizeof(regex_t));
+	memcpy(copy_ccl, ccl_buf, ccl_bufidx);
+	
+	for (i = 0; i < j; i++)
+	{
+		if ((copy[i].type == CHAR_CLASS) || (copy[i].type == INV_CHAR_CLASS))
+		{
+			copy[i].u.ccl = copy_ccl + (re_compiled[i].u.ccl - ccl_buf);
+		}
+	}
 	
-	return (re_t) re_compiled;
+	/* A pattern that fits is matched bit-parallel, if there is the memory for it. */
+	copy[j].u.bp = compilebitparallel(copy);
+	
+	return (re_t) copy;
 }
 
-void re_print(regex_t* pattern)
+void re_free(re_t pattern)
 {
-	const char* types[] = { "UNUSED", "DOT", "BEGIN", "END", "QUESTIONMARK", "STAR", "PLUS", "CHAR", "CHAR_CLASS", "INV_CHAR_CLASS", "DIGIT", "NOT_DIGIT", "ALPHA", "NOT_ALPHA", "WHITESPACE", "NOT_WHITESPACE", "BRANCH" };
-	
+	if (pattern != 0)
+	{
+		dropprofile(findprofile(pattern));
+		free(getbitparallel(pattern));
+		free(pattern);
+	}
+}
+
+void re_print(re_t pattern)
+{
+	char symbol[MAX_CHAR_CLASS_LEN + 32];
 	int i;
-	int j;
-	char c;
-	for (i = 0; i < MAX_REGEXP_OBJECTS; ++i)
+	
+	for (i = 0; (i < MAX_REGEXP_OBJECTS) && (pattern[i].type != UNUSED); ++i)
 	{
-		if (pattern[i].type == UNUSED)
+		describesymbol(&pattern[i], symbol);
+		printf("type: %s\n", symbol);
+	}
+}
+
+void re_set_budget(long steps)
+{
+	budget = steps;
+}
+
+int re_profile_start(re_t pattern)
+{
+	profile_t* profile = findprofile(pattern);
+	
+	if (profile == 0)
+	{
+		profile = (profile_t*) malloc(sizeof(profile_t));
+		if (profile == 0)
 		{
-			break;
+			return -1;
 		}
 		
-		printf("type: %s", types[pattern[i].type]);
-		if (pattern[i].type == CHAR_CLASS || pattern[i].type == INV_CHAR_CLASS)
-		{
-			printf(" [");
-			for (j = 0; j < MAX_CHAR_CLASS_LEN; ++j)
-			{
-				c = pattern[i].u.ccl[j];
-				if ((c == '\0') || (c == ']'))
-				{
-					break;
-				}
-				printf("%c", c);
-			}
-			printf("]");
-		}
-		else if (pattern[i].type == CHAR)
+		profile->next = profiles;
+		profiles = profile;
+	}
+	
+	memset(profile, 0, offsetof(profile_t, next));
+	profile->pattern = pattern;
+	
+	return 0;
+}
+
+void re_profile_report(re_t pattern, FILE* out)
+{
+	profile_t* profile = findprofile(pattern);
+	char symbol[MAX_CHAR_CLASS_LEN + 32];
+	int i;
+	
+	if (profile == 0)
+	{
+		return;
+	}
+	
+	if ((getbitparallel(pattern) != 0) && (pattern[0].type != BEGIN))
+	{
+		fprintf(out, "  matched bit-parallel, without backtracking\n");
+	}
+	else
+	{
+		fprintf(out, "  %-34s %12ld\n", "starts tried", profile->starts);
+		fprintf(out, "  %-34s %12ld\n", "starts abandoned", profile->abandoned);
+	}
+	
+	fprintf(out, "  %-34s %12s %12s %12s\n", "symbol", "tried", "backtracked", "stopped at");
+	
+	for (i = 0; (i < MAX_REGEXP_OBJECTS) && (pattern[i].type != UNUSED); ++i)
+	{
+		describesymbol(&pattern[i], symbol);
+		fprintf(out, "  %2d %-31.31s %12ld %12ld %12ld\n", i, symbol, profile->tried[i],
+				profile->backtracked[i], profile->stopped[i]);
+	}
+	
+	if (profile->worstCount > 0)
+	{
+		fprintf(out, "  costliest abandoned starts:\n");
+		
+		for (i = 0; i < profile->worstCount; i++)
 		{
-			printf(" '%c'", pattern[i].u.ch);
+			fprintf(out, "    %10ld steps at offset %-6d %s\n", profile->worst[i].steps,
+					profile->worst[i].offset, profile->worst[i].text);
 		}
-		printf("\n");
 	}
+	
+	dropprofile(profile);
 }
 
 
@@ -398,9 +924,169 @@ static int matchcharclass(char c, const char* str)
 	return 0;
 }
 
+/* Returns non-zero if pattern starts with an assertion (one that isn't made optional
+   or repeated, which would leave it matching nothing at all). */
+static int isassertion(regex_t* pattern)
+{
+	unsigned char type = pattern[0].type;
+	unsigned char next = pattern[1].type;
+	
+	return ((type == WORD_BOUNDARY) || (type == NOT_WORD_BOUNDARY) || (type == WORD_START) || (type == WORD_END)) &&
+		(next != QUESTIONMARK) && (next != STAR) && (next != PLUS);
+}
+
+/* Returns non-zero if the assertion holds between the character before text (if it is
+   not at the start of the line) and the one at text. */
+static int matchassertion(unsigned char type, const char* text)
+{
+	int before = (text > linestart) && matchalphanum(text[-1]);
+	int after = (text[0] != '\0') && matchalphanum(text[0]);
+	
+	switch (type)
+	{
+	case WORD_BOUNDARY:     return before != after;
+	case NOT_WORD_BOUNDARY: return before == after;
+	case WORD_START:        return !before;
+	default:                return !after;
+	}
+}
+
+/* Return the profile of pattern, or 0 if it isn't being profiled. */
+static profile_t* findprofile(regex_t* pattern)
+{
+	profile_t* profile;
+	
+	for (profile = profiles; (profile != 0) && (profile->pattern != pattern); profile = profile->next)
+	{
+	}
+	
+	return profile;
+}
+
+/* Stop profiling a pattern, if it is being profiled. */
+static void dropprofile(profile_t* profile)
+{
+	profile_t** link;
+	
+	if (profile == 0)
+	{
+		return;
+	}
+	
+	for (link = &profiles; *link != profile; link = &(*link)->next)
+	{
+	}
+	
+	*link = profile->next;
+	if (profiling == profile)
+	{
+		profiling = 0;
+	}
+	
+	free(profile);
+}
+
+static void startattempt(void)
+{
+	profiling->starts++;
+	profiling->steps = 0;
+	profiling->deepest = 0;
+}
+
+/* Count the start at offset in the line, where text is, as abandoned, keeping it among
+   the costliest if it is one of them. */
+static void abandonattempt(const char* text, int offset)
+{
+	profile_t* p = profiling;
+	int i, j;
+	
+	p->abandoned++;
+	p->stopped[p->deepest]++;
+	
+	if ((p->worstCount == PROFILE_WORST) && (p->steps <= p->worst[PROFILE_WORST - 1].steps))
+	{
+		return;
+	}
+	
+	if (p->worstCount < PROFILE_WORST)
+	{
+		p->worstCount++;
+	}
+	
+	for (i = p->worstCount - 1; (i > 0) && (p->worst[i - 1].steps < p->steps); i--)
+	{
+		p->worst[i] = p->worst[i - 1];
+	}
+	
+	p->worst[i].steps = p->steps;
+	p->worst[i].offset = offset;
+	
+	/* the text is shown as it stands, with anything unprintable made a '.' */
+	for (j = 0; (j < PROFILE_EXCERPT) && (text[j] != '\0'); j++)
+	{
+		p->worst[i].text[j] = isprint((unsigned char) text[j]) ? text[j] : '.';
+	}
+	
+	p->worst[i].text[j] = '\0';
+}
+
+/* Count a try of the symbol p against a character; returns 1, to stand in a test. */
+static int countsymbol(regex_t* p)
+{
+	int i = (int) (p - profiling->pattern);
+	
+	profiling->tried[i]++;
+	profiling->steps++;
+	if (i > profiling->deepest)
+	{
+		profiling->deepest = i;
+	}
+	
+	return 1;
+}
+
+/* Count a failure of the rest of the pattern after the '*', '+' or '?' at p. */
+static int countbacktrack(regex_t* p)
+{
+	profiling->backtracked[p - profiling->pattern]++;
+	profiling->steps++;
+	
+	return 1;
+}
+
+/* Write the name of the symbol p, with its character or class, into buf, returning its
+   length. */
+static int describesymbol(regex_t* p, char* buf)
+{
+	int len = sprintf(buf, "%s", typenames[p->type]);
+	int j;
+	char c;
+	
+	if (p->type == CHAR_CLASS || p->type == INV_CHAR_CLASS)
+	{
+		len += sprintf(buf + len, " [");
+		for (j = 0; j < MAX_CHAR_CLASS_LEN; ++j)
+		{
+			c = p->u.ccl[j];
+			if ((c == '\0') || (c == ']'))
+			{
+				break;
+			}
+			buf[len++] = c;
+		}
+		len += sprintf(buf + len, "]");
+	}
+	else if (p->type == CHAR)
+	{
+		len += sprintf(buf + len, " '%c'", p->u.ch);
+	}
+	
+	return len;
+}
+
 static int matchone(regex_t p, char c)
 {
-	const char* types[] = { "UNUSED", "DOT", "BEGIN", "END", "QUESTIONMARK", "STAR", "PLUS", "CHAR", "CHAR_CLASS", "INV_CHAR_CLASS", "DIGIT", "NOT_DIGIT", "ALPHA", "NOT_ALPHA", "WHITESPACE", "NOT_WHITESPACE", "BRANCH" };
+	const char* types[] = { "UNUSED", "DOT", "BEGIN", "END", "QUESTIONMARK", "STAR", "PLUS", "CHAR", "CHAR_CLASS", "INV_CHAR_CLASS", "DIGIT", "NOT_DIGIT", "ALPHA", "NOT_ALPHA", "WHITESPACE", "NOT_WHITESPACE", "WORD_BOUNDARY", "NOT_WORD_BOUNDARY", "WORD_START", "WORD_END", "BRANCH" };
 	int result = -1;
 	
 	switch (p.type)
@@ -415,6 +1101,10 @@ static int matchone(regex_t p, char c)
     case WHITESPACE:     result =  matchwhitespace(c); break;
     case NOT_WHITESPACE: result = !matchwhitespace(c); break;
     case BEGIN:          result = 0; break;
+    case WORD_BOUNDARY:
+    case NOT_WORD_BOUNDARY:
+    case WORD_START:
+    case WORD_END:       result = 0; break;
     default:             result =  (p.u.ch == c); break;
     }
     
@@ -425,11 +1115,186 @@ static int matchone(regex_t p, char c)
   	return result;
 }
 
+/* Build the tables for matching pattern bit-parallel, or return 0 if it has a symbol
+   that doesn't match exactly one character.  The masks are found by asking matchone
+   about every character, so that the two ways of matching always agree. */
+static bitparallel_t* compilebitparallel(regex_t* pattern)
+{
+	bitparallel_t* bp;
+	int i, c, length, atEnd = 0, wordEnd = 0;
+	int atStart = (pattern[0].type == BEGIN);
+	int wordStart = (pattern[atStart].type == WORD_START);
+	
+	/* a leading '^' is only of use to re_find_approx; re_find_next deals with it first */
+	for (length = atStart + wordStart; pattern[length].type != UNUSED; length++)
+	{
+		switch (pattern[length].type)
+		{
+		case DOT: case CHAR: case CHAR_CLASS: case INV_CHAR_CLASS:
+		case DIGIT: case NOT_DIGIT: case ALPHA: case NOT_ALPHA:
+		case WHITESPACE: case NOT_WHITESPACE:
+			break;
+			
+		case WORD_END:
+			if ((pattern[length + 1].type == UNUSED) ||
+				((pattern[length + 1].type == END) && (pattern[length + 2].type == UNUSED)))
+			{
+				wordEnd = 1;
+				break;
+			}
+			return 0;
+			
+		case END:
+			if (pattern[length + 1].type == UNUSED)
+			{
+				atEnd = 1;
+				break;
+			}
+			return 0;
+			
+		default:
+			return 0;
+		}
+	}
+	
+	length -= atStart + wordStart + atEnd + wordEnd;
+	pattern += atStart + wordStart;
+	
+	if ((length == 0) || (length > (int) (8 * sizeof(unsigned long))))
+	{
+		return 0;
+	}
+	
+	bp = (bitparallel_t*) malloc(sizeof(bitparallel_t));
+	if (bp == 0)
+	{
+		return 0;
+	}
+	
+	bp->length = length;
+	bp->atStart = atStart;
+	bp->atEnd = atEnd;
+	bp->wordStart = wordStart;
+	bp->wordEnd = wordEnd;
+	
+	/* the text ends at a nul, so nothing matches one */
+	bp->masks[0] = 0;
+	for (c = 1; c < 256; c++)
+	{
+		bp->masks[c] = 0;
+		for (i = 0; i < length; i++)
+		{
+			if (matchone(pattern[i], (char) c))
+			{
+				bp->masks[c] |= 1UL << i;
+			}
+		}
+	}
+	
+	return bp;
+}
+
+/* Return the bit-parallel tables kept in the sentinel at the end of pattern. */
+static bitparallel_t* getbitparallel(regex_t* pattern)
+{
+	while (pattern->type != UNUSED)
+	{
+		pattern++;
+	}
+	
+	return pattern->u.bp;
+}
+
+/* Find the first match of a bit-parallel pattern in text, returning its index (and
+   its length, which is always the number of symbols) or -1 if there is none. */
+static int findbitparallel(bitparallel_t* bp, const char* text, int* matchlength)
+{
+	const unsigned char* t = (const unsigned char*) text;
+	const unsigned long* masks = bp->masks;
+	unsigned long d, found;
+	int m = bp->length;
+	int i, n, pos, last;
+	
+	*matchlength = 0;
+	
+	if (bp->atEnd)
+	{
+		/* only the last m characters can match */
+		n = (int) strlen(text);
+		if (n < m)
+		{
+			return -1;
+		}
+		
+		d = ~0UL;
+		for (i = 0; (i < m) && (d != 0); i++)
+		{
+			d &= masks[t[n - m + i]] >> i;
+		}
+		
+		if ((d & 1) == 0)
+		{
+			return -1;
+		}
+		
+		*matchlength = m;
+		return n - m;
+	}
+	
+	if (m < MIN_BNDM_LEN)
+	{
+		/* shift-and: bit i of d is set if the last i+1 characters match the first i+1 symbols */
+		found = 1UL << (m - 1);
+		d = 0;
+		for (i = 0; t[i] != '\0'; i++)
+		{
+			d = ((d << 1) | 1) & masks[t[i]];
+			if (d & found)
+			{
+				*matchlength = m;
+				return i + 1 - m;
+			}
+		}
+		
+		return -1;
+	}
+	
+	/* BNDM: each window of m characters is read from its end, with bit i of d set while
+	   the characters read so far match the symbols from i on.  Bit 0 then means they are
+	   a prefix of the pattern, so the next window to try starts there. */
+	n = (int) strlen(text);
+	pos = 0;
+	while (pos <= n - m)
+	{
+		i = m;
+		last = m;
+		d = ~0UL;
+		while ((i > 0) && (d != 0))
+		{
+			d &= masks[t[pos + --i]];
+			if (d & 1)
+			{
+				if (i == 0)
+				{
+					*matchlength = m;
+					return pos;
+				}
+				last = i;
+			}
+			d >>= 1;
+		}
+		
+		pos += last;
+	}
+	
+	return -1;
+}
+
 static int matchstar(regex_t p, regex_t* pattern, const char* text, int* matchlength)
 {
 	int prelen = *matchlength;
 	const char* prepoint = text;
-	while ((text[0] != '\0') && matchone(p, *text))
+	while ((text[0] != '\0') && TRIED(pattern - 2) && matchone(p, *text))
 	{
 		text++;
 		(*matchlength)++;
@@ -439,6 +1304,14 @@ static int matchstar(regex_t p, regex_t* pattern, const char* text, int* matchle
 		if (matchpattern(pattern, text--, matchlength))
 			return 1;
 		(*matchlength)--;
+		if (profiling != 0)
+		{
+			countbacktrack(pattern - 1);
+		}
+		if (--stepsleft < 0)
+		{
+			break;
+		}
 	}
 	
 	*matchlength = prelen;
@@ -448,7 +1321,7 @@ static int matchstar(regex_t p, regex_t* pattern, const char* text, int* matchle
 static int matchplus(regex_t p, regex_t* pattern, const char* text, int* matchlength)
 {
 	const char* prepoint = text;
-	while ((text[0] != '\0') && matchone(p, *text))
+	while ((text[0] != '\0') && TRIED(pattern - 2) && matchone(p, *text))
 	{
 		text++;
 		(*matchlength)++;
@@ -458,6 +1331,14 @@ static int matchplus(regex_t p, regex_t* pattern, const char* text, int* matchle
 		if (matchpattern(pattern, text--, matchlength))
 			return 1;
 		(*matchlength)--;
+		if (profiling != 0)
+		{
+			countbacktrack(pattern - 1);
+		}
+		if (--stepsleft < 0)
+		{
+			break;
+		}
 	}
 	
 	return 0;
@@ -471,7 +1352,7 @@ static int matchquestion(regex_t p, regex_t* pattern, const char* text, int* mat
 		result = 1;
 	} else if (matchpattern(pattern, text, matchlength)) {
 		result = 1;
-	} else if (*text && matchone(p, *text++)) {
+	} else if (BACKTRACKED(pattern - 1) && (--stepsleft >= 0) && *text && TRIED(pattern - 2) && matchone(p, *text++)) {
 		if (matchpattern(pattern, text, matchlength))
 		{
 			(*matchlength)++;
@@ -532,6 +1413,17 @@ static int matchpattern(regex_t* pattern, const char* text, int* matchlength)
 	int result = 0;
 	do
 	{
+		/* an assertion reads nothing, so it is checked and passed over where it stands */
+		while (isassertion(pattern) && matchassertion(pattern[0].type, text))
+		{
+			pattern++;
+		}
+		
+		if (isassertion(pattern))
+		{
+			break;
+		}
+		
 		if ((pattern[0].type == UNUSED) || (pattern[1].type == QUESTIONMARK))
 		{
 			result = matchquestion(pattern[0], &pattern[2], text, matchlength);
@@ -557,7 +1449,7 @@ static int matchpattern(regex_t* pattern, const char* text, int* matchlength)
 			(*matchlength)++;
 		}
 	}
-	while ((result == 0) && (text[0] != '\0') && matchone(*pattern++, *text++));
+	while ((result == 0) && (text[0] != '\0') && TRIED(pattern) && matchone(*pattern++, *text++));
 	
 	if (result == 0) {
 		*matchlength = pre;
@@ -23,6 +23,8 @@
  *   '\W'       Non-alphanumeric
  *   '\d'       Digits, [0-9]
  *   '\D'       Non-digits
+ *   '\b'       Word boundary, between a word character and a non-word character
+ *   '\B'       Not a word boundary
  *
  *
  */
@@ -30,6 +32,7 @@
 #ifndef _TINY_REGEX_C
 #define _TINY_REGEX_C
 
+#include <stdio.h>
 
 #ifndef RE_DOT_MATCHES_NEWLINE
 /* Define to 0 if you DON'T want '.' to match '\r' + '\n' */
@@ -46,18 +49,96 @@ extern "C"{
 typedef struct regex_t* re_t;
 
 
-/* Compile regex string pattern to a regex_t-array. */
+/* Compile regex string pattern to a regex_t-array.  Each compiled pattern has storage of
+   its own, to be released with re_free. */
 re_t re_compile(const char* pattern);
 
 
+/* Flags for re_compile_flags: a match must be a whole word (with no word character
+   just before or after it), or the whole line. */
+#define RE_WORD 1
+#define RE_LINE 2
+
+
+/* Compile pattern as re_compile does, with the assertions that flags call for built
+   into it, so that the matcher itself passes over matches that don't satisfy them. */
+re_t re_compile_flags(const char* pattern, int flags);
+
+
+/* Release a pattern compiled with re_compile. */
+void re_free(re_t pattern);
+
+
 /* Find matches of the compiled pattern inside text. */
 int re_matchp(re_t pattern, const char* text, int* matchlength);
 
 
+/* Find the next match of the compiled pattern inside text, starting at *offset (0 for
+   the first call).  Returns the index of the match and its length, and moves *offset
+   past it, so that successive calls walk the non-overlapping matches of a line in a
+   single pass.  Returns -1 (and sets *offset to -1) once there are no more matches. */
+int re_find_next(re_t pattern, const char* text, int* offset, int* matchlength);
+
+
+/* Copy the longest run of literal characters that every match of the compiled pattern
+   must contain into literal (at most size characters), returning its length, or 0 if
+   there is no such run.  Used to skip text that cannot hold a match. */
+int re_literal(re_t pattern, char* literal, int size);
+
+
+/* The most errors re_find_approx will allow in a match. */
+#define RE_MAX_ERRORS 8
+
+
+/* Returns non-zero if the compiled pattern can be matched with errors by re_find_approx:
+   that is, if each of its symbols matches a single character, and any '^' or '$' is at
+   its start or end. */
+int re_can_approx(re_t pattern);
+
+
+/* Find the next match of the compiled pattern inside text that is within errors
+   insertions, deletions and substitutions of it, as re_find_next does for exact
+   matches.  The match found is the first to end, carried on for as long as that lowers
+   its errors, and starting wherever gives it the fewest errors (the nearest such place
+   to its end). */
+int re_find_approx(re_t pattern, int errors, const char* text, int* offset, int* matchlength);
+
+
 /* Find matches of the txt pattern inside text (will compile automatically first). */
 int re_match(const char* pattern, const char* text, int* matchlength);
 
 
+/* re_find_next returns this, rather than an index, if it gave up on the text after
+   using up the budget set by re_set_budget. */
+#define RE_OVER_BUDGET -2
+
+
+/* Limit the backtracking that each call of re_find_next may do to steps: that is, the
+   times the rest of a pattern fails after a '*', '+' or '?' so that it has to give
+   back what it took (the steps that re_profile_report counts).  A call that uses them
+   up gives up, returning RE_OVER_BUDGET, so that the text can be matched some other
+   way.  0, as it starts, sets no limit. */
+void re_set_budget(long steps);
+
+
+/* Print the symbols of the compiled pattern, one to a line. */
+void re_print(re_t pattern);
+
+
+/* Start counting the work that the backtracking matcher does on the compiled pattern:
+   how many times each symbol is tried against a character, how often the rest of the
+   pattern fails after a '*', '+' or '?' so that it has to give back what it took, and
+   how far each start that is abandoned got, with the costliest of them.  A pattern
+   matched bit-parallel is never backtracked over, so nothing is counted for it.
+   Returns 0, or -1 if there is not enough memory. */
+int re_profile_start(re_t pattern);
+
+
+/* Write the counts kept since re_profile_start to out, against the symbols of the
+   pattern as re_print lists them, and stop counting. */
+void re_profile_report(re_t pattern, FILE* out);
+
+
 #ifdef __cplusplus
 }
 #endif
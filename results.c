@@ -0,0 +1,245 @@
+/*
+ * An on-disk cache of search results, for gsgrep --cache-dir.
+ *
+ * Each file searched has an entry in the cache directory, named for a hash of the
+ * search and the path of the file.  The entry starts with the identity of the file,
+ * whether it matched and the search and path themselves (so that two that hash the
+ * same are told apart), and then holds the output exactly as it was written.  Entries
+ * are written to a temporary file and renamed into place once they are complete, so
+ * that searches running at the same time never see half of one.
+ */
+
+#include "results.h"
+#include "output.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define RESULTS_MAGIC "gsgrep results 1\n"
+
+struct result_cache {
+	char*    dir;
+	char*    query;
+	long     hits;
+	long     misses;
+	
+	FILE*    recording;      /* the entry being written, while recording     */
+	char*    entryName;
+	char*    tempName;
+	long     matchedAt;      /* the offset of the matched flag in the entry  */
+};
+
+
+
+/* Private functions: */
+
+static unsigned long hashBytes(unsigned long hash, unsigned long multiplier, const char* data) {
+	while (*data != '\0') {
+		hash = ((hash ^ (unsigned char) *data++) * multiplier) & 0xFFFFFFFFUL;
+	}
+	
+	return hash;
+}
+
+/* Returns the name of the entry for path, which the caller frees, or NULL if there is
+   not enough memory. */
+static char* entryName(result_cache* cache, const char* path) {
+	unsigned long high, low;
+	char* name;
+	
+	if ((name = (char*) malloc(strlen(cache->dir) + 40)) == NULL) {
+		return NULL;
+	}
+	
+	high = hashBytes(hashBytes(2166136261UL, 16777619UL, cache->query), 16777619UL, path);
+	low = hashBytes(hashBytes(5381UL, 33UL, cache->query), 33UL, path);
+	sprintf(name, "%s/%08lx%08lx", cache->dir, high, low);
+	
+	return name;
+}
+
+/* Writes the header of an entry, up to and including the search and path. */
+static int writeHeader(result_cache* cache, FILE* entry, const char* path, const results_file* file) {
+	fputs(RESULTS_MAGIC, entry);
+	fprintf(entry, "%lu %lu %ld %ld %ld ", file->device, file->inode, file->size, file->modified,
+			(long) (strlen(cache->query) + strlen(path) + 1));
+	cache->matchedAt = ftell(entry);
+	fprintf(entry, "0\n%s\n%s", cache->query, path);
+	
+	return ferror(entry) ? -1 : 0;
+}
+
+/* Reads the header of an entry, returning whether the search matched, or -1 if the
+   entry isn't for this search of this file as it now is. */
+static int readHeader(result_cache* cache, FILE* entry, const char* path, const results_file* file) {
+	char line[128], *key;
+	results_file kept;
+	long keyLength;
+	int matched, rc = -1;
+	
+	if ((fgets(line, sizeof(line), entry) == NULL) || strcmp(line, RESULTS_MAGIC) ||
+		(fgets(line, sizeof(line), entry) == NULL) ||
+		(sscanf(line, "%lu %lu %ld %ld %ld %d", &kept.device, &kept.inode, &kept.size, &kept.modified,
+				&keyLength, &matched) != 6)) {
+		return -1;
+	}
+	
+	if ((kept.device != file->device) || (kept.inode != file->inode) || (kept.size != file->size) ||
+		(kept.modified != file->modified) ||
+		(keyLength != (long) (strlen(cache->query) + strlen(path) + 1))) {
+		return -1;
+	}
+	
+	if ((key = (char*) malloc(keyLength)) == NULL) {
+		return -1;
+	}
+	
+	if ((fread(key, 1, keyLength, entry) == (size_t) keyLength) &&
+		!memcmp(key, cache->query, strlen(cache->query)) && (key[strlen(cache->query)] == '\n') &&
+		!memcmp(&key[strlen(cache->query) + 1], path, strlen(path))) {
+		rc = matched;
+	}
+	
+	free(key);
+	return rc;
+}
+
+
+
+/* Public functions: */
+
+result_cache* results_open(const char* dir, const char* query) {
+	result_cache* cache;
+	
+	#ifndef __ORCAC__
+	if ((mkdir(dir, 0777) < 0) && (errno != EEXIST)) {
+		return NULL;
+	}
+	#endif
+	
+	if ((cache = (result_cache*) calloc(1, sizeof(result_cache))) == NULL) {
+		return NULL;
+	}
+	
+	cache->dir = (char*) malloc(strlen(dir) + 1);
+	cache->query = (char*) malloc(strlen(query) + 1);
+	
+	if ((cache->dir == NULL) || (cache->query == NULL)) {
+		results_close(cache);
+		return NULL;
+	}
+	
+	strcpy(cache->dir, dir);
+	strcpy(cache->query, query);
+	
+	return cache;
+}
+
+int results_replay(result_cache* cache, const char* path, const results_file* file) {
+	char buf[4096], *name;
+	FILE* entry;
+	long n;
+	int matched = -1;
+	
+	if ((name = entryName(cache, path)) == NULL) {
+		cache->misses++;
+		return -1;
+	}
+	
+	if ((entry = fopen(name, "rb")) != NULL) {
+		if ((matched = readHeader(cache, entry, path, file)) >= 0) {
+			while ((n = (long) fread(buf, 1, sizeof(buf), entry)) > 0) {
+				out_write(buf, n);
+			}
+			
+			out_flush();
+		}
+		
+		fclose(entry);
+	}
+	
+	free(name);
+	
+	if (matched < 0) {
+		cache->misses++;
+	} else {
+		cache->hits++;
+	}
+	
+	return matched;
+}
+
+int results_record(result_cache* cache, const char* path, const results_file* file) {
+	if ((cache->entryName = entryName(cache, path)) == NULL) {
+		return -1;
+	}
+	
+	if ((cache->tempName = (char*) malloc(strlen(cache->entryName) + 24)) == NULL) {
+		free(cache->entryName);
+		return -1;
+	}
+	
+	#ifdef __ORCAC__
+	sprintf(cache->tempName, "%s.tmp", cache->entryName);
+	#else
+	sprintf(cache->tempName, "%s.%ld", cache->entryName, (long) getpid());
+	#endif
+	
+	if (((cache->recording = fopen(cache->tempName, "wb")) == NULL) ||
+		(writeHeader(cache, cache->recording, path, file) < 0)) {
+		if (cache->recording != NULL) {
+			fclose(cache->recording);
+			remove(cache->tempName);
+			cache->recording = NULL;
+		}
+		
+		free(cache->entryName);
+		free(cache->tempName);
+		return -1;
+	}
+	
+	out_copy(cache->recording);
+	return 0;
+}
+
+void results_finish(result_cache* cache, int matched) {
+	out_copy(NULL);
+	
+	if (matched >= 0) {
+		fseek(cache->recording, cache->matchedAt, SEEK_SET);
+		fputc('0' + matched, cache->recording);
+	}
+	
+	if ((fclose(cache->recording) != 0) || (matched < 0) || (rename(cache->tempName, cache->entryName) != 0)) {
+		remove(cache->tempName);
+	}
+	
+	cache->recording = NULL;
+	free(cache->entryName);
+	free(cache->tempName);
+}
+
+long results_hits(result_cache* cache) {
+	return cache->hits;
+}
+
+long results_misses(result_cache* cache) {
+	return cache->misses;
+}
+
+void results_close(result_cache* cache) {
+	if (cache != NULL) {
+		free(cache->dir);
+		free(cache->query);
+		free(cache);
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * An on-disk cache of search results, for gsgrep --cache-dir.
+ *
+ * The output a search writes for a file is kept in the cache directory, under the
+ * search (its patterns and options), the path of the file and the identity of the file
+ * itself: its device, inode, size and modification time.  While none of these have
+ * changed, the output is written out again from the cache and the file is never opened.
+ */
+
+#ifndef _GSGREP_RESULTS_H
+#define _GSGREP_RESULTS_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct result_cache result_cache;
+
+
+/* The identity of a file, any change to which means it has to be searched again. */
+typedef struct {
+	unsigned long  device;
+	unsigned long  inode;
+	long           size;
+	long           modified;
+} results_file;
+
+
+/* Use the directory dir (which is created if need be) to cache the results of the
+   search described by query.  Returns NULL if the directory can't be made or there is
+   not enough memory. */
+result_cache* results_open(const char* dir, const char* query);
+
+
+/* If the results of searching file as path are cached, write the output kept for it
+   with out_write and return whether it matched (0 or 1); otherwise return -1. */
+int results_replay(result_cache* cache, const char* path, const results_file* file);
+
+
+/* Start recording everything written to stdout through the output module, as the
+   results of searching file as path.  Returns 0, or -1 if they can't be recorded. */
+int results_record(result_cache* cache, const char* path, const results_file* file);
+
+
+/* Finish the recording started by results_record, keeping it as the results of a
+   search that matched (0 or 1), or throwing it away if matched is -1. */
+void results_finish(result_cache* cache, int matched);
+
+
+/* Returns the number of files whose results were found in the cache, or weren't. */
+long results_hits(result_cache* cache);
+long results_misses(result_cache* cache);
+
+
+/* Finish with a cache opened with results_open. */
+void results_close(result_cache* cache);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_RESULTS_H */
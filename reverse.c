@@ -0,0 +1,156 @@
+/*
+ * Reading a file backwards, a line at a time, for gsgrep --reverse.
+ *
+ * The buffer holds the part of the range read so far that hasn't been handed out yet,
+ * which always runs up to the start of the last line handed out.  Lines are taken off
+ * its end; when it holds no more whole lines, what is left of it (the end of a line
+ * whose start hasn't been read yet) is moved up to the end of the buffer and the block
+ * of the file before it is read in ahead of it.
+ */
+
+#include "reverse.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+struct reverse_reader {
+	FILE*    file;
+	char     lineEnd;
+	long     start;              /* the offset the range starts at               */
+	long     lo;                 /* the offset of the first byte in the buffer   */
+	long     used;               /* the bytes in the buffer, from lo on          */
+	long     size;
+	char*    buffer;
+};
+
+
+
+/* Private functions: */
+
+/* Reads the block of the file before what is in the buffer in ahead of it, returning
+   the number of bytes read, or -1 on an error. */
+static long readBlock(reverse_reader* reader) {
+	long n = reader->size - reader->used;
+	
+	if (n > reader->lo - reader->start) {
+		n = reader->lo - reader->start;
+	}
+	
+	memmove(reader->buffer + n, reader->buffer, reader->used);
+	
+	if ((fseek(reader->file, reader->lo - n, SEEK_SET) != 0) ||
+		(fread(reader->buffer, 1, n, reader->file) != (size_t) n)) {
+		return -1;
+	}
+	
+	reader->lo -= n;
+	reader->used += n;
+	
+	return n;
+}
+
+/* Returns the offset in the buffer of the last line in it, which runs to the end of the
+   buffer, reading more of the file until the start of the line is in the buffer.  Returns
+   -1 on an error. */
+static long lastLine(reverse_reader* reader) {
+	long i = reader->used - 2;
+	
+	for (;;) {
+		// the last byte is the line's own line end, if it has one.
+		//
+		for (; i >= 0; i--) {
+			if (reader->buffer[i] == reader->lineEnd) {
+				return i + 1;
+			}
+		}
+		
+		// a line that fills the whole buffer is handed out a part at a time, leaving room
+		// to end each part.
+		//
+		if (reader->used == reader->size) {
+			return 1;
+		}
+		
+		if (reader->lo == reader->start) {
+			return 0;
+		}
+		
+		if ((i = readBlock(reader)) < 0) {
+			return -1;
+		}
+		
+		// only the bytes just read are new, and if the buffer was empty the last of them
+		// is the line end again.
+		//
+		i = (i < reader->used) ? i - 1 : reader->used - 2;
+	}
+}
+
+
+
+/* Public functions: */
+
+reverse_reader* reverse_open(FILE* file, char lineEnd, long start, long end, long blockSize) {
+	reverse_reader* reader;
+	
+	if ((reader = (reverse_reader*) malloc(sizeof(reverse_reader))) == NULL) {
+		return NULL;
+	}
+	
+	if ((reader->buffer = (char*) malloc(blockSize)) == NULL) {
+		free(reader);
+		return NULL;
+	}
+	
+	reader->file = file;
+	reader->lineEnd = lineEnd;
+	reader->start = start;
+	reader->lo = end;
+	reader->used = 0;
+	reader->size = blockSize;
+	
+	return reader;
+}
+
+long reverse_read(reverse_reader* reader, char* buf, long len) {
+	long got = 0, lineStart, length;
+	int ended;
+	
+	while ((reader->used > 0) || (reader->lo > reader->start)) {
+		if ((lineStart = lastLine(reader)) < 0) {
+			return -1;
+		}
+		
+		// the last line of the file may not have a line end, but the lines are put in a
+		// different order, so it needs one.
+		//
+		length = reader->used - lineStart;
+		ended = (length > 0) && (reader->buffer[reader->used - 1] == reader->lineEnd);
+		
+		if (got + length + !ended > len) {
+			break;
+		}
+		
+		memcpy(buf + got, reader->buffer + lineStart, length);
+		got += length;
+		
+		if (!ended) {
+			buf[got++] = reader->lineEnd;
+		}
+		
+		reader->used = lineStart;
+	}
+	
+	return got;
+}
+
+void reverse_close(reverse_reader* reader) {
+	if (reader != NULL) {
+		free(reader->buffer);
+		free(reader);
+	}
+}
@@ -0,0 +1,46 @@
+/*
+ * Reading a file backwards, a line at a time, for gsgrep --reverse.
+ *
+ * A reverse reader reads a range of a file from its end towards its start in blocks,
+ * splitting the lines out of each block from the end, and hands them out last line
+ * first.  Each line is handed out whole and in the right order within itself, ending
+ * with the line end, so that the text read can be searched just as if it were read
+ * forwards: it is only the order of the lines that is turned around.
+ */
+
+#ifndef _GSGREP_REVERSE_H
+#define _GSGREP_REVERSE_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct reverse_reader reverse_reader;
+
+
+/* Start reading the lines of file, which end with lineEnd, from the offset end back to
+   the offset start, in blocks of blockSize bytes.  A line longer than the block (less
+   one byte) is handed out in parts, the last part first.  Returns NULL if there is not
+   enough memory. */
+reverse_reader* reverse_open(FILE* file, char lineEnd, long start, long end, long blockSize);
+
+
+/* Read up to len bytes of whole lines into buf, where len is at least the block size,
+   returning the number of bytes read, 0 once the start of the range has been reached,
+   or -1 if the file could not be read or seeked. */
+long reverse_read(reverse_reader* reader, char* buf, long len);
+
+
+/* Finish with a reader opened with reverse_open. */
+void reverse_close(reverse_reader* reader);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_REVERSE_H */
@@ -0,0 +1,175 @@
+/*
+ * Block scanning primitives for gsgrep.
+ *
+ * Where the compiler targets SSE2 or AVX2, the counting loop compares a whole vector
+ * of bytes at once and counts the hits with a popcount of the comparison mask, and the
+ * literal search compares the first and last bytes of the literal against a vector of
+ * starting places at once, so that only the places where both agree are looked at
+ * further.  The plain C versions are used by ORCA/C and anywhere else.
+ */
+
+#include "scan.h"
+#include <ctype.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+long scan_count(const char* data, long len, char c) {
+	long count = 0;
+	long idx = 0;
+	const char* found;
+	
+	#if defined(__AVX2__)
+	const __m256i needle = _mm256_set1_epi8(c);
+	
+	while (idx + 32 <= len) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*) &data[idx]);
+		
+		count += __builtin_popcount((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+		idx += 32;
+	}
+	#elif defined(__SSE2__)
+	const __m128i needle = _mm_set1_epi8(c);
+	
+	while (idx + 16 <= len) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) &data[idx]);
+		
+		count += __builtin_popcount((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+		idx += 16;
+	}
+	#endif
+	
+	data += idx;
+	len -= idx;
+	
+	while ((len > 0) && ((found = scan_find_char(data, len, c)) != NULL)) {
+		count++;
+		len -= (found - data) + 1;
+		data = found + 1;
+	}
+	
+	return count;
+}
+
+const char* scan_find_char(const char* data, long len, char c) {
+	return (len > 0) ? (const char*) memchr(data, c, len) : NULL;
+}
+
+const char* scan_find_last_char(const char* data, long len, char c) {
+	while (len > 0) {
+		if (data[--len] == c) {
+			return &data[len];
+		}
+	}
+	
+	return NULL;
+}
+
+/* Returns non-zero if the litlen bytes at data are the literal lit. */
+static int matchesAt(const char* data, const char* lit, int litlen, int fold) {
+	int idx;
+	
+	if (!fold) {
+		return (memcmp(data, lit, litlen) == 0);
+	}
+	
+	for (idx = 0; idx < litlen; idx++) {
+		if (tolower((unsigned char) data[idx]) != lit[idx]) {
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+const char* scan_find(const char* data, long len, const char* lit, int litlen, int fold) {
+	const char* end = data + len - litlen;
+	char last, lastUpper, firstUpper;
+	
+	if (litlen <= 0) {
+		return (len >= 0) ? data : NULL;
+	}
+	
+	/* the places where the first and last bytes of the literal both agree are the only
+	   ones worth comparing in full. */
+	last = lit[litlen - 1];
+	firstUpper = fold ? (char) toupper((unsigned char) lit[0]) : lit[0];
+	lastUpper = fold ? (char) toupper((unsigned char) last) : last;
+	
+	#if defined(__AVX2__) || defined(__SSE2__)
+	{
+		#if defined(__AVX2__)
+		const __m256i first1 = _mm256_set1_epi8(lit[0]), first2 = _mm256_set1_epi8(firstUpper);
+		const __m256i last1 = _mm256_set1_epi8(last), last2 = _mm256_set1_epi8(lastUpper);
+		const long width = 32;
+		#else
+		const __m128i first1 = _mm_set1_epi8(lit[0]), first2 = _mm_set1_epi8(firstUpper);
+		const __m128i last1 = _mm_set1_epi8(last), last2 = _mm_set1_epi8(lastUpper);
+		const long width = 16;
+		#endif
+		unsigned int mask;
+		int bit;
+		
+		while (end - data + 1 >= width) {
+			#if defined(__AVX2__)
+			__m256i head = _mm256_loadu_si256((const __m256i*) data);
+			__m256i tail = _mm256_loadu_si256((const __m256i*) &data[litlen - 1]);
+			
+			mask = (unsigned int) _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(head, first1), _mm256_cmpeq_epi8(head, first2)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(tail, last1), _mm256_cmpeq_epi8(tail, last2))));
+			#else
+			__m128i head = _mm_loadu_si128((const __m128i*) data);
+			__m128i tail = _mm_loadu_si128((const __m128i*) &data[litlen - 1]);
+			
+			mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(head, first1), _mm_cmpeq_epi8(head, first2)),
+				_mm_or_si128(_mm_cmpeq_epi8(tail, last1), _mm_cmpeq_epi8(tail, last2))));
+			#endif
+			
+			while (mask != 0) {
+				bit = __builtin_ctz(mask);
+				
+				if (matchesAt(&data[bit], lit, litlen, fold)) {
+					return &data[bit];
+				}
+				
+				mask &= mask - 1;
+			}
+			
+			data += width;
+		}
+	}
+	#endif
+	
+	if (!fold) {
+		while ((data <= end) && ((data = scan_find_char(data, end - data + 1, lit[0])) != NULL)) {
+			if ((data[litlen - 1] == last) && matchesAt(data, lit, litlen, fold)) {
+				return data;
+			}
+			
+			data++;
+		}
+		
+		return NULL;
+	}
+	
+	for (; data <= end; data++) {
+		if (((data[0] == lit[0]) || (data[0] == firstUpper)) &&
+			((data[litlen - 1] == last) || (data[litlen - 1] == lastUpper)) &&
+			matchesAt(data, lit, litlen, fold)) {
+			return data;
+		}
+	}
+	
+	return NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * Block scanning primitives for gsgrep.
+ *
+ * grep() reads its input a block at a time rather than a line at a time.  These
+ * routines do the byte level work on a block: finding the literal text that every
+ * match of the pattern must contain, finding the line around it, and counting line
+ * ends so that line numbers only need to be worked out for the lines printed.
+ */
+
+#ifndef _GSGREP_SCAN_H
+#define _GSGREP_SCAN_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Count the occurrences of the byte c in the len bytes at data. */
+long scan_count(const char* data, long len, char c);
+
+
+/* Find the first occurrence of the byte c in the len bytes at data, returning NULL
+   if there is none. */
+const char* scan_find_char(const char* data, long len, char c);
+
+
+/* Find the last occurrence of the byte c in the len bytes at data, returning NULL if
+   there is none. */
+const char* scan_find_last_char(const char* data, long len, char c);
+
+
+/* Find the first occurrence of the literal lit (of litlen bytes) in the len bytes at
+   data, returning NULL if there is none.  If fold is non-zero, lit must be lower case
+   and the text is compared without regard to case. */
+const char* scan_find(const char* data, long len, const char* lit, int litlen, int fold);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_SCAN_H */
@@ -0,0 +1,342 @@
+/*
+ * Streaming search of a pattern set, for gsgrep and for programs that embed it.
+ *
+ * When the patterns require a literal, the complete lines of a chunk are not split
+ * up one by one: the chunk is scanned for the literal, and only the lines holding it
+ * are given to the matcher.  Line numbers are worked out only for the lines that
+ * match, by counting the line ends passed over since the last of them.
+ */
+
+#include "search.h"
+#include "scan.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+/* the longest required literal taken from the patterns to drive the scan. */
+#define MAX_LITERAL 32
+
+struct search_context {
+	pattern_set*     patterns;
+	int              options;
+	char             lineEnd;
+	search_callback  found;
+	void*            data;
+	int              stopped;      /* the callback has asked for the search to end  */
+	
+	char             literal[MAX_LITERAL];
+	int              literalLength;
+	
+	char*            chunk;        /* the text being fed                            */
+	long             fed;          /* the bytes fed before chunk                    */
+	long             lineNumber;   /* the number of the line that starts at counted */
+	char*            counted;      /* line ends before this have been counted       */
+	long             matches;
+	unsigned char*   hits;
+	
+	long             lines;        /* with SEARCH_COUNT_LINES                       */
+	long             candidates;
+	search_clock     clock;
+	long             matchTime;
+	
+	char             carry[SEARCH_MAX_LINE + 1];  /* the partial line left over     */
+	int              carryLength;
+	long             carryOffset;
+	char             folded[SEARCH_MAX_LINE + 1];
+};
+
+
+
+/* Private functions: */
+
+/* Matches the line held nul terminated at text, that starts offset bytes into the
+   text fed.  Returns 1 if it matched, 0 if it didn't, or -1 if the callback asked to
+   stop. */
+static int searchLine(search_context* ctx, char* text, int length, long offset) {
+	search_line line;
+	char* buf = text;
+	long started;
+	int i, matched;
+	
+	if ((ctx->options & SEARCH_IGNORE_CASE) != 0) {
+		for (i = 0; i <= length; i++) {
+			ctx->folded[i] = isalpha((unsigned char) text[i]) ? tolower((unsigned char) text[i]) : text[i];
+		}
+		
+		buf = ctx->folded;
+	}
+	
+	ctx->candidates++;
+	
+	if (ctx->clock != NULL) {
+		started = ctx->clock();
+		matched = patset_match(ctx->patterns, buf, ctx->hits);
+		ctx->matchTime += ctx->clock() - started;
+	} else {
+		matched = patset_match(ctx->patterns, buf, ctx->hits);
+	}
+	
+	if (matched == 0) {
+		return 0;
+	}
+	
+	ctx->matches++;
+	
+	if ((ctx->options & SEARCH_LINE_NUMBERS) != 0) {
+		ctx->lineNumber += scan_count(ctx->counted, text - ctx->counted, ctx->lineEnd);
+		ctx->counted = text;
+	}
+	
+	line.text = text;
+	line.matched = buf;
+	line.length = length;
+	line.lineNumber = ctx->lineNumber;
+	line.offset = offset;
+	line.hits = ctx->hits;
+	
+	if (ctx->found(ctx->data, &line) != 0) {
+		ctx->stopped = 1;
+		return -1;
+	}
+	
+	return 1;
+}
+
+/* Matches length bytes of the chunk at text as a line, nul terminating it in place
+   for as long as that takes. */
+static int searchInPlace(search_context* ctx, char* text, int length) {
+	char saved = text[length];
+	int rc;
+	
+	text[length] = '\0';
+	rc = searchLine(ctx, text, length, ctx->fed + (text - ctx->chunk));
+	text[length] = saved;
+	
+	return rc;
+}
+
+/* Matches the partial line that has been carried over as a line. */
+static int searchCarry(search_context* ctx) {
+	int length = ctx->carryLength;
+	
+	ctx->carry[length] = '\0';
+	ctx->carryLength = 0;
+	ctx->counted = ctx->carry;
+	
+	return searchLine(ctx, ctx->carry, length, ctx->carryOffset);
+}
+
+/* Searches the complete lines of the chunk between start and end, which is just past
+   a line end. */
+static int searchRegion(search_context* ctx, char* start, char* end) {
+	char *p = start, *lineStart, *lineEnd, *found;
+	long length;
+	
+	while (p < end) {
+		lineStart = p;
+		
+		if (ctx->literalLength > 0) {
+			found = (char*) scan_find(p, end - p, ctx->literal, ctx->literalLength,
+									  (ctx->options & SEARCH_IGNORE_CASE) != 0);
+			
+			if (found == NULL) {
+				break;
+			}
+			
+			if ((lineStart = (char*) scan_find_last_char(p, found - p, ctx->lineEnd)) != NULL) {
+				lineStart++;
+			} else {
+				lineStart = p;
+			}
+		}
+		
+		lineEnd = (char*) scan_find_char(lineStart, end - lineStart, ctx->lineEnd);
+		p = lineEnd + 1;
+		
+		if ((length = lineEnd - lineStart) > SEARCH_MAX_LINE) {
+			// too long to match as it is; the rest is taken as the next line.
+			length = SEARCH_MAX_LINE;
+			p = lineStart + length;
+		}
+		
+		if (searchInPlace(ctx, lineStart, (int) length) < 0) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+
+
+/* Public functions: */
+
+search_context* search_new(pattern_set* set, int options, char lineEnd,
+						   search_callback found, void* data) {
+	search_context* ctx = (search_context*) malloc(sizeof(search_context));
+	
+	if (ctx == NULL) {
+		return NULL;
+	}
+	
+	ctx->patterns = set;
+	ctx->options = options;
+	ctx->lineEnd = lineEnd;
+	ctx->found = found;
+	ctx->data = data;
+	ctx->stopped = 0;
+	ctx->literalLength = patset_literal(set, ctx->literal, MAX_LITERAL);
+	ctx->chunk = NULL;
+	ctx->fed = 0;
+	ctx->lineNumber = 1;
+	ctx->counted = ctx->carry;
+	ctx->matches = 0;
+	ctx->hits = NULL;
+	ctx->lines = 0;
+	ctx->candidates = 0;
+	ctx->clock = NULL;
+	ctx->matchTime = 0;
+	ctx->carryLength = 0;
+	ctx->carryOffset = 0;
+	
+	if ((options & SEARCH_PATTERN_HITS) != 0) {
+		if ((ctx->hits = (unsigned char*) malloc(patset_count(set))) == NULL) {
+			free(ctx);
+			return NULL;
+		}
+	}
+	
+	return ctx;
+}
+
+void search_set_line_end(search_context* ctx, char lineEnd) {
+	ctx->lineEnd = lineEnd;
+}
+
+void search_set_clock(search_context* ctx, search_clock clock) {
+	ctx->clock = clock;
+}
+
+int search_feed(search_context* ctx, char* buf, long len) {
+	char *p = buf, *end = buf + len, *last;
+	long n, take;
+	
+	if (ctx->stopped) {
+		return -1;
+	}
+	
+	if ((ctx->options & SEARCH_COUNT_LINES) != 0) {
+		ctx->lines += scan_count(buf, len, ctx->lineEnd);
+	}
+	
+	ctx->chunk = buf;
+	ctx->counted = buf;
+	
+	// the line carried over from the last chunk is finished off first, from as much of
+	// this one as it takes.  one that has filled the carry is left until now, so that
+	// a line end straight after it isn't taken for an empty line.
+	//
+	if (ctx->carryLength > 0) {
+		last = (char*) scan_find_char(buf, len, ctx->lineEnd);
+		n = (last != NULL) ? last - buf : len;
+		take = SEARCH_MAX_LINE - ctx->carryLength;
+		
+		if (take > n) {
+			take = n;
+		}
+		
+		memcpy(&ctx->carry[ctx->carryLength], buf, take);
+		ctx->carryLength += (int) take;
+		p = buf + take;
+		
+		if ((take < n) || (last != NULL)) {
+			if (searchCarry(ctx) < 0) {
+				return -1;
+			}
+			
+			// the line end (if it was reached) is counted from here.
+			//
+			ctx->counted = p;
+			
+			if (p == last) {
+				p++;
+			}
+		} else {
+			ctx->fed += len;
+			return 0;
+		}
+	}
+	
+	if ((last = (char*) scan_find_last_char(p, end - p, ctx->lineEnd)) != NULL) {
+		if (searchRegion(ctx, p, last + 1) < 0) {
+			return -1;
+		}
+		
+		p = last + 1;
+	}
+	
+	while (end - p > SEARCH_MAX_LINE) {
+		if (searchInPlace(ctx, p, SEARCH_MAX_LINE) < 0) {
+			return -1;
+		}
+		
+		p += SEARCH_MAX_LINE;
+	}
+	
+	if ((ctx->options & SEARCH_LINE_NUMBERS) != 0) {
+		ctx->lineNumber += scan_count(ctx->counted, p - ctx->counted, ctx->lineEnd);
+	}
+	
+	ctx->counted = ctx->carry;
+	ctx->carryOffset = ctx->fed + (p - buf);
+	ctx->carryLength = (int) (end - p);
+	memcpy(ctx->carry, p, ctx->carryLength);
+	ctx->fed += len;
+	
+	return 0;
+}
+
+int search_finish(search_context* ctx) {
+	if (ctx->stopped) {
+		return -1;
+	}
+	
+	if (ctx->carryLength > 0) {
+		if ((ctx->options & SEARCH_COUNT_LINES) != 0) {
+			ctx->lines++;
+		}
+		
+		if (searchCarry(ctx) < 0) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+long search_matches(search_context* ctx) {
+	return ctx->matches;
+}
+
+long search_offset(search_context* ctx) {
+	return ctx->fed;
+}
+
+void search_get_stats(search_context* ctx, search_stats* stats) {
+	stats->lines = ctx->lines;
+	stats->candidates = ctx->candidates;
+	stats->matches = ctx->matches;
+	stats->matchTime = ctx->matchTime;
+}
+
+void search_free(search_context* ctx) {
+	if (ctx != NULL) {
+		free(ctx->hits);
+		free(ctx);
+	}
+}
@@ -0,0 +1,119 @@
+/*
+ * Streaming search of a pattern set, for gsgrep and for programs that embed it.
+ *
+ * A search context holds a compiled pattern set, the options for the search and a
+ * callback.  Text is pushed into it in chunks of any size with search_feed, as it
+ * arrives; the complete lines in each chunk are matched where they lie in the caller's
+ * buffer, and only the partial line left at the end of a chunk is kept, to be joined
+ * up with the start of the next.  Each matching line is handed to the callback.
+ */
+
+#ifndef _GSGREP_SEARCH_H
+#define _GSGREP_SEARCH_H
+
+#include "patset.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct search_context search_context;
+
+
+/* Lines longer than this are split, and each part matched as a line on its own. */
+#define SEARCH_MAX_LINE 16384
+
+
+/* Options for search_new: match without regard to case (the patterns must have been
+   added to the set in lower case), work out the number of each matching line, work
+   out which of the patterns matched it, and count all of the lines fed. */
+#define SEARCH_IGNORE_CASE   1
+#define SEARCH_LINE_NUMBERS  2
+#define SEARCH_PATTERN_HITS  4
+#define SEARCH_COUNT_LINES   8
+
+
+/* A matching line, as handed to the callback. */
+typedef struct {
+	char* text;                  /* the line, nul terminated, without its line end     */
+	char* matched;               /* the text the patterns matched: text, or text folded
+	                                to lower case with SEARCH_IGNORE_CASE              */
+	int length;
+	long lineNumber;             /* counting from 1, with SEARCH_LINE_NUMBERS          */
+	long offset;                 /* of the start of the line within the text fed       */
+	unsigned char* hits;         /* with SEARCH_PATTERN_HITS, hits[id] is 1 for each
+	                                pattern that matched, as for patset_match          */
+} search_line;
+
+
+/* What a search has done so far, as given by search_get_stats. */
+typedef struct {
+	long lines;                  /* the lines fed, with SEARCH_COUNT_LINES             */
+	long candidates;             /* the lines matched against the patterns: those the
+	                                scan for the patterns' literal didn't pass over    */
+	long matches;
+	long matchTime;              /* the time that matching them took, as read from the
+	                                clock given to search_set_clock                    */
+} search_stats;
+
+
+/* Reads the time, in any units, for search_set_clock. */
+typedef long (*search_clock)(void);
+
+
+/* Called with each line that matches.  The line is only valid until the callback
+   returns.  Returns 0 to carry on searching, or anything else to stop. */
+typedef int (*search_callback)(void* data, search_line* line);
+
+
+/* Create a context that searches for the patterns of set (which must outlive it) in
+   lines ending with lineEnd, calling found with data for every matching line.  Returns
+   NULL if there is not enough memory. */
+search_context* search_new(pattern_set* set, int options, char lineEnd,
+						   search_callback found, void* data);
+
+
+/* Change the character that ends each line, before any text has been fed. */
+void search_set_line_end(search_context* ctx, char lineEnd);
+
+
+/* Time the matching of lines against the patterns with clock, which is read before
+   and after each line is matched. */
+void search_set_clock(search_context* ctx, search_clock clock);
+
+
+/* Search the len bytes at buf, carrying on from the text fed before them.  The buffer
+   is written to while the lines in it are matched, but is left as it was, and is never
+   needed again once search_feed returns.  Returns 0, or -1 if the callback has asked
+   for the search to stop (after which nothing more is searched). */
+int search_feed(search_context* ctx, char* buf, long len);
+
+
+/* Search the partial line left at the end of the text, if there is one, as the last
+   line.  Returns as search_feed does. */
+int search_finish(search_context* ctx);
+
+
+/* Returns the number of lines that have matched so far. */
+long search_matches(search_context* ctx);
+
+
+/* Returns the number of bytes that have been fed so far. */
+long search_offset(search_context* ctx);
+
+
+/* Fill in stats with what the search has done so far. */
+void search_get_stats(search_context* ctx, search_stats* stats);
+
+
+/* Release a context created with search_new. */
+void search_free(search_context* ctx);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_SEARCH_H */
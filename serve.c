@@ -0,0 +1,420 @@
+/*
+ * Answering searches from a long running server, for gsgrep --serve and --connect.
+ *
+ * A query is sent as a four byte length and then the arguments, each nul terminated,
+ * with the client's standard input, output and error and a descriptor for its working
+ * directory passed alongside the first of it.  The server puts them in place of its
+ * own while it runs the query, puts its own back, and replies with a single byte
+ * holding the exit status.  There are no sockets on the IIGS.
+ */
+
+#include "serve.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+/* the client's standard input, output and error, and its working directory. */
+#define PASSED_FDS 4
+
+/* the longest query that will be taken, in bytes of arguments. */
+#define MAX_QUERY (1024L * 1024L)
+
+/* the longest a client may take to send its query, in seconds. */
+#define QUERY_TIMEOUT 5
+
+
+
+/* Private functions: */
+
+#ifndef __ORCAC__
+
+/* Opens a stream socket and fills in the address of path, returning the socket or -1. */
+static int openSocket(const char* path, struct sockaddr_un* addr) {
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+/* Makes way for a server to listen at addr, the address of path.  A socket left behind
+   by a server that has gone (one that refuses connections) is removed; anything else
+   is left alone, failing with EADDRINUSE if it is a socket that a server may still be
+   using, or EEXIST if it isn't a socket at all.  Returns 0, or -1. */
+static int clearPath(const char* path, struct sockaddr_un* addr) {
+	struct stat info;
+	int probe, refused;
+	
+	if (lstat(path, &info) < 0) {
+		return (errno == ENOENT) ? 0 : -1;
+	}
+	
+	if (!S_ISSOCK(info.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+	
+	if ((probe = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	
+	refused = (connect(probe, (struct sockaddr*) addr, sizeof(*addr)) < 0) && (errno == ECONNREFUSED);
+	close(probe);
+	
+	if (!refused) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+	
+	return unlink(path);
+}
+
+static int readFully(int fd, char* buf, long len) {
+	long n;
+	
+	while (len > 0) {
+		if ((n = read(fd, buf, len)) <= 0) {
+			if ((n < 0) && (errno == EINTR)) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		buf += n;
+		len -= n;
+	}
+	
+	return 0;
+}
+
+static int writeFully(int fd, const char* buf, long len) {
+	long n;
+	
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) <= 0) {
+			if ((n < 0) && (errno == EINTR)) {
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		buf += n;
+		len -= n;
+	}
+	
+	return 0;
+}
+
+static void closeAll(int* fds, int count) {
+	int i;
+	
+	for (i = 0; i < count; i++) {
+		close(fds[i]);
+	}
+}
+
+/* Receives the length of a query and the descriptors passed with it, returning the
+   length, or -1 if the client sent something else.  Every descriptor that arrives is
+   closed unless it is one of the expected ones, in a header that is good. */
+static long receiveHeader(int conn, int* fds) {
+	unsigned char header[4];
+	char control[CMSG_SPACE(PASSED_FDS * sizeof(int))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	char* data;
+	long n;
+	int received = 0, messages = 0, count, fd, i;
+	
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	
+	if ((n = recvmsg(conn, &msg, 0)) <= 0) {
+		return -1;
+	}
+	
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS)) {
+			continue;
+		}
+		
+		// no more is read than the control buffer holds, whatever the length claims.
+		//
+		data = (char*) CMSG_DATA(cmsg);
+		count = (int) ((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		
+		if (data + count * sizeof(int) > control + msg.msg_controllen) {
+			count = (int) ((control + msg.msg_controllen - data) / sizeof(int));
+		}
+		
+		for (i = 0; i < count; i++) {
+			memcpy(&fd, data + i * sizeof(int), sizeof(int));
+			
+			if (received < PASSED_FDS) {
+				fds[received] = fd;
+			} else {
+				close(fd);
+			}
+			
+			received++;
+		}
+		
+		messages++;
+	}
+	
+	if (((msg.msg_flags & MSG_CTRUNC) != 0) || (messages != 1) || (received != PASSED_FDS) ||
+		((n < (long) sizeof(header)) && (readFully(conn, (char*) &header[n], sizeof(header) - n) < 0))) {
+		closeAll(fds, (received < PASSED_FDS) ? received : PASSED_FDS);
+		return -1;
+	}
+	
+	return ((long) header[0] << 24) | ((long) header[1] << 16) | ((long) header[2] << 8) | header[3];
+}
+
+/* Runs a query with the passed descriptors in place of this process's own. */
+static int runQuery(serve_handler handler, int* fds, int argc, char** argv) {
+	int saved[PASSED_FDS], i, status;
+	
+	fflush(stdout);
+	fflush(stderr);
+	
+	for (i = 0; i < 3; i++) {
+		saved[i] = dup(i);
+		dup2(fds[i], i);
+	}
+	
+	saved[3] = open(".", O_RDONLY);
+	
+	if (fchdir(fds[3]) < 0) {
+		perror("--serve");
+		status = 2;
+	} else {
+		status = handler(argc, argv);
+	}
+	
+	fflush(stdout);
+	fflush(stderr);
+	
+	if (saved[3] >= 0) {
+		fchdir(saved[3]);
+		close(saved[3]);
+	}
+	
+	// anything left over from the client's input is no concern of the next query, so
+	// stdin is reopened to drop what it has buffered before its descriptor is put back.
+	//
+	if (freopen("/dev/null", "r", stdin) == NULL) {
+		perror("--serve");
+	}
+	
+	for (i = 0; i < 3; i++) {
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	
+	return status;
+}
+
+/* Answers the query sent down a connection. */
+static void answer(int conn, serve_handler handler) {
+	int fds[PASSED_FDS], argc, i;
+	char **argv, *query, *p;
+	long len;
+	unsigned char status;
+	
+	if ((len = receiveHeader(conn, fds)) < 0) {
+		return;
+	}
+	
+	if ((len > 0) && (len <= MAX_QUERY) && ((query = (char*) malloc(len)) != NULL)) {
+		if ((readFully(conn, query, len) == 0) && (query[len - 1] == '\0')) {
+			for (argc = 0, p = query; p < query + len; p += strlen(p) + 1) {
+				argc++;
+			}
+			
+			if ((argv = (char**) malloc((argc + 1) * sizeof(char*))) != NULL) {
+				for (i = 0, p = query; i < argc; p += strlen(p) + 1) {
+					argv[i++] = p;
+				}
+				
+				argv[argc] = NULL;
+				status = (unsigned char) runQuery(handler, fds, argc, argv);
+				writeFully(conn, (char*) &status, 1);
+				free(argv);
+			}
+		}
+		
+		free(query);
+	}
+	
+	closeAll(fds, PASSED_FDS);
+}
+
+#endif
+
+
+
+/* Public functions: */
+
+int serve_listen(const char* path, serve_handler handler) {
+	#ifdef __ORCAC__
+	return -1;
+	#else
+	struct sockaddr_un addr;
+	struct timeval timeout;
+	int sock, conn;
+	
+	if ((sock = openSocket(path, &addr)) < 0) {
+		return -1;
+	}
+	
+	// a socket left behind by an earlier server that has gone is taken over, but not
+	// one that a server is still listening on, nor a file that isn't a socket.
+	//
+	if (clearPath(path, &addr) < 0) {
+		close(sock);
+		return -1;
+	}
+	
+	if ((bind(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) || (listen(sock, 16) < 0)) {
+		close(sock);
+		return -1;
+	}
+	
+	// a client that goes away before its answer is written mustn't take the server
+	// with it.
+	//
+	signal(SIGPIPE, SIG_IGN);
+	
+	for (;;) {
+		if ((conn = accept(sock, NULL, NULL)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			close(sock);
+			return -1;
+		}
+		
+		// queries are answered one at a time, so a client that connects and sends
+		// nothing mustn't hold up the ones waiting behind it.
+		//
+		timeout.tv_sec = QUERY_TIMEOUT;
+		timeout.tv_usec = 0;
+		setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		
+		answer(conn, handler);
+		close(conn);
+	}
+	#endif
+}
+
+int serve_query(const char* path, int argc, char** argv) {
+	#ifdef __ORCAC__
+	return -1;
+	#else
+	struct sockaddr_un addr;
+	int sock, fds[PASSED_FDS], i;
+	char control[CMSG_SPACE(PASSED_FDS * sizeof(int))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	unsigned char header[4], status;
+	char *query, *p;
+	long len = 0;
+	
+	for (i = 0; i < argc; i++) {
+		len += strlen(argv[i]) + 1;
+	}
+	
+	if ((query = (char*) malloc(len)) == NULL) {
+		return -1;
+	}
+	
+	for (i = 0, p = query; i < argc; i++) {
+		strcpy(p, argv[i]);
+		p += strlen(argv[i]) + 1;
+	}
+	
+	if ((sock = openSocket(path, &addr)) < 0) {
+		free(query);
+		return -1;
+	}
+	
+	if (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		close(sock);
+		free(query);
+		return -1;
+	}
+	
+	fds[0] = 0;
+	fds[1] = 1;
+	fds[2] = 2;
+	fds[3] = open(".", O_RDONLY);
+	
+	header[0] = (unsigned char) (len >> 24);
+	header[1] = (unsigned char) (len >> 16);
+	header[2] = (unsigned char) (len >> 8);
+	header[3] = (unsigned char) len;
+	
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(PASSED_FDS * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, PASSED_FDS * sizeof(int));
+	
+	fflush(stdout);
+	fflush(stderr);
+	
+	if ((fds[3] < 0) || (sendmsg(sock, &msg, 0) != sizeof(header)) ||
+		(writeFully(sock, query, len) < 0) || (readFully(sock, (char*) &status, 1) < 0)) {
+		if (fds[3] >= 0) {
+			close(fds[3]);
+		}
+		
+		close(sock);
+		free(query);
+		return -1;
+	}
+	
+	close(fds[3]);
+	close(sock);
+	free(query);
+	
+	return status;
+	#endif
+}
@@ -0,0 +1,39 @@
+/*
+ * Answering searches from a long running server, for gsgrep --serve and --connect.
+ *
+ * The server listens on a Unix socket.  A client sends it the arguments it was run
+ * with, along with its standard input, output and error and its working directory, so
+ * that the server can run the search just as the client would have done itself, reading
+ * and writing the client's own files, and then sends back the exit status.
+ */
+
+#ifndef _GSGREP_SERVE_H
+#define _GSGREP_SERVE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Runs one query with the arguments a client was run with (argv[0] and all), and with
+   the client's standard files and working directory in place, returning the exit
+   status to send back to it. */
+typedef int (*serve_handler)(int argc, char** argv);
+
+
+/* Listen on the Unix socket at path, answering the queries of each client in turn with
+   handler.  A client that takes more than a few seconds to send its query is dropped.  Only returns if the socket can't be set up or fails, returning -1. */
+int serve_listen(const char* path, serve_handler handler);
+
+
+/* Have the server listening at path run the query given by argc and argv, reading and
+   writing this process's standard files.  Returns its exit status, or -1 if the server
+   can't be reached. */
+int serve_query(const char* path, int argc, char** argv);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_SERVE_H */
@@ -0,0 +1,206 @@
+/*
+ * Where the time goes in a search, for gsgrep --stats.
+ *
+ * gsgrep searches on a single thread, so the counters are just statics.  Times are
+ * kept in the units of the clock they are read from: microseconds where there is a
+ * monotonic clock, and ticks of clock() on the IIGS.
+ */
+
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#define TICKS_PER_SECOND CLOCKS_PER_SEC
+#else
+#define TICKS_PER_SECOND 1000000L
+#endif
+
+typedef struct {
+	char*    name;
+	long     time;
+} slowFile;
+
+static int enabled = 0;
+static long started;
+static long phaseTimes[STATS_PHASES];
+static long counters[STATS_COUNTERS];
+
+/* the slowest files so far, slowest first. */
+static slowFile* slowest = NULL;
+static int slowestSize = 0;
+static int slowestCount = 0;
+
+static const char* phaseNames[STATS_PHASES] = {
+	"finding files", "opening files", "reading", "scanning", "matching", "output"
+};
+
+static const char* counterNames[STATS_COUNTERS] = {
+	"files searched", "files skipped", "bytes read", "lines", "lines matched against",
+	"lines matching", "patterns over the limit"
+};
+
+
+
+/* Private functions: */
+
+static long readClock(void) {
+	#ifdef __ORCAC__
+	return (long) clock();
+	#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long) ts.tv_sec * 1000000L + (long) (ts.tv_nsec / 1000L);
+	#endif
+}
+
+static void forgetSlowest(void) {
+	int i;
+	
+	for (i = 0; i < slowestCount; i++) {
+		free(slowest[i].name);
+	}
+	
+	free(slowest);
+	slowest = NULL;
+	slowestCount = slowestSize = 0;
+}
+
+static double milliseconds(long time) {
+	return (double) time * 1000.0 / (double) TICKS_PER_SECOND;
+}
+
+
+
+/* Public functions: */
+
+int stats_start(int slowestWanted) {
+	int i;
+	
+	for (i = 0; i < STATS_PHASES; i++) {
+		phaseTimes[i] = 0;
+	}
+	
+	for (i = 0; i < STATS_COUNTERS; i++) {
+		counters[i] = 0;
+	}
+	
+	forgetSlowest();
+	slowestSize = slowestWanted;
+	
+	if ((slowestSize > 0) && ((slowest = (slowFile*) calloc(slowestSize, sizeof(slowFile))) == NULL)) {
+		slowestSize = 0;
+		return -1;
+	}
+	
+	enabled = 1;
+	started = readClock();
+	
+	return 0;
+}
+
+int stats_enabled(void) {
+	return enabled;
+}
+
+long stats_clock(void) {
+	return enabled ? readClock() : 0;
+}
+
+long stats_time(int phase, long startedAt) {
+	long time;
+	
+	if (!enabled) {
+		return 0;
+	}
+	
+	time = readClock() - startedAt;
+	phaseTimes[phase] += time;
+	
+	return time;
+}
+
+void stats_add_time(int phase, long time) {
+	phaseTimes[phase] += time;
+}
+
+void stats_count(int counter, long n) {
+	counters[counter] += n;
+}
+
+void stats_file(const char* name, long time) {
+	int i;
+	
+	if (!enabled || (slowestSize == 0) ||
+		((slowestCount == slowestSize) && (time <= slowest[slowestCount - 1].time))) {
+		return;
+	}
+	
+	// the file goes in order among the slowest, dropping the fastest of them if need be.
+	//
+	if (slowestCount == slowestSize) {
+		free(slowest[--slowestCount].name);
+	}
+	
+	for (i = slowestCount; (i > 0) && (slowest[i - 1].time < time); i--) {
+		slowest[i] = slowest[i - 1];
+	}
+	
+	if ((slowest[i].name = (char*) malloc(strlen(name) + 1)) != NULL) {
+		strcpy(slowest[i].name, name);
+	}
+	
+	slowest[i].time = time;
+	slowestCount++;
+}
+
+void stats_report(const char* name) {
+	long total, other;
+	int i;
+	
+	if (!enabled) {
+		return;
+	}
+	
+	total = readClock() - started;
+	other = total;
+	
+	fprintf(stderr, "%s: stats\n", name);
+	
+	for (i = 0; i < STATS_COUNTERS; i++) {
+		fprintf(stderr, "  %-24s %12ld\n", counterNames[i], counters[i]);
+	}
+	
+	fprintf(stderr, "  %-24s %12.1f ms\n", "time", milliseconds(total));
+	
+	for (i = 0; i < STATS_PHASES; i++) {
+		fprintf(stderr, "    %-22s %12.1f ms %5.1f%%\n", phaseNames[i], milliseconds(phaseTimes[i]),
+				(total > 0) ? phaseTimes[i] * 100.0 / total : 0.0);
+		other -= phaseTimes[i];
+	}
+	
+	fprintf(stderr, "    %-22s %12.1f ms %5.1f%%\n", "other", milliseconds(other),
+			(total > 0) ? other * 100.0 / total : 0.0);
+	
+	if (total > 0) {
+		fprintf(stderr, "  %-24s %12.1f MB/s\n", "throughput",
+				counters[STATS_BYTES] / 1048576.0 / (milliseconds(total) / 1000.0));
+	}
+	
+	if (slowestCount > 0) {
+		fprintf(stderr, "  slowest files:\n");
+		
+		for (i = 0; i < slowestCount; i++) {
+			fprintf(stderr, "    %10.1f ms  %s\n", milliseconds(slowest[i].time),
+					(slowest[i].name != NULL) ? slowest[i].name : "?");
+		}
+	}
+	
+	forgetSlowest();
+	enabled = 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Where the time goes in a search, for gsgrep --stats.
+ *
+ * The search reads the clock around each phase of its work (finding files, opening
+ * them, reading them, scanning them for the patterns' literal, matching the patterns
+ * and writing the output) and adds the time taken to that phase, and counts the files,
+ * bytes and lines it gets through.  Until stats_start is called nothing is kept and the
+ * clock isn't read, so the calls can stay in place at next to no cost.
+ */
+
+#ifndef _GSGREP_STATS_H
+#define _GSGREP_STATS_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* The phases of a search. */
+#define STATS_TRAVERSE     0     /* finding the files to search                     */
+#define STATS_OPEN         1     /* opening and closing them                        */
+#define STATS_READ         2
+#define STATS_SCAN         3     /* splitting lines and scanning for the literal    */
+#define STATS_MATCH        4     /* matching lines against the patterns             */
+#define STATS_OUTPUT       5
+#define STATS_PHASES       6
+
+
+/* The things counted. */
+#define STATS_FILES        0     /* files (and members of images and archives) read */
+#define STATS_SKIPPED      1     /* files passed over without being read            */
+#define STATS_BYTES        2
+#define STATS_LINES        3
+#define STATS_CANDIDATES   4     /* lines matched against the patterns              */
+#define STATS_MATCHES      5     /* lines that matched                              */
+#define STATS_FALLBACKS    6     /* patterns that went over the backtracking limit  */
+#define STATS_COUNTERS     7
+
+
+/* Start keeping stats afresh, along with the slowest files searched, up to slowest of
+   them.  Returns 0, or -1 if there is not enough memory. */
+int stats_start(int slowest);
+
+
+/* Returns non-zero if stats are being kept. */
+int stats_enabled(void);
+
+
+/* Returns the time, in units that only stats_time and stats_add_time need know, or 0 if
+   stats aren't being kept. */
+long stats_clock(void);
+
+
+/* Add the time since started (as read from stats_clock) to phase, returning it. */
+long stats_time(int phase, long started);
+
+
+/* Add time (which may be negative, to move time from one phase to another) to phase. */
+void stats_add_time(int phase, long time);
+
+
+/* Add n to counter. */
+void stats_count(int counter, long n);
+
+
+/* Note that the file called name took time (the difference of two readings of
+   stats_clock) to search. */
+void stats_file(const char* name, long time);
+
+
+/* Write out the stats kept since stats_start to stderr, headed by name (that of the
+   program), and stop keeping them. */
+void stats_report(const char* name);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_STATS_H */
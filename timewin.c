@@ -0,0 +1,324 @@
+/*
+ * Finding the part of a log that falls within a window of time, for gsgrep --since
+ * and --until.
+ *
+ * Each end of the window is found by a binary search over offsets in the file.  The
+ * offset probed stands for the first timestamped line starting at or after it, and
+ * since the lines are in order, whether that line is past the end of the window being
+ * looked for only ever changes once, from no to yes, as the offset goes up.  Timestamps
+ * are turned into a pair of numbers that compare in the same order as the times.
+ */
+
+#include "timewin.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ORCAC__
+#pragma memorymodel 1
+#pragma lint -1
+#endif
+
+/* a timestamp must start within this many bytes of the start of its line. */
+#define MAX_STAMP 256
+
+enum {
+	Year,
+	Month,
+	Day,
+	Hour,
+	Minute,
+	Second,
+	FieldCount
+};
+
+typedef struct {
+	long     date;               /* year * 10000 + month * 100 + day             */
+	long     time;               /* hour * 10000 + minute * 100 + second         */
+} stamp;
+
+struct time_window {
+	char*    format;
+	int      hasSince;
+	int      hasUntil;
+	stamp    since;
+	stamp    until;
+};
+
+static const char monthNames[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+
+
+
+/* Private functions: */
+
+/* Returns the field a conversion sets, or -1 if it isn't one. */
+static int conversionField(char conversion) {
+	switch (conversion) {
+	case 'Y': return Year;
+	case 'm':
+	case 'b': return Month;
+	case 'd':
+	case 'e': return Day;
+	case 'H': return Hour;
+	case 'M': return Minute;
+	case 'S': return Second;
+	}
+	
+	return -1;
+}
+
+/* Parses a time at the start of text, which is len bytes long, as format describes.
+   With partial, the text may stop short of the format once it has given at least one
+   field, and the fields it doesn't reach are taken to be as late as they could be if
+   latest is set, or as early otherwise.  Returns the number of bytes of text the time
+   took up, or -1 if it doesn't match. */
+static long parseTime(const char* format, const char* text, long len, int partial, int latest,
+					  stamp* when) {
+	int fields[FieldCount];
+	int i, field, digits, found = 0, ended = 0;
+	long pos = 0;
+	
+	for (i = 0; i < FieldCount; i++) {
+		fields[i] = 0;
+	}
+	
+	for (; *format != '\0'; format++) {
+		if ((pos == len) && partial && (found > 0)) {
+			ended = 1;
+		}
+		
+		if ((*format == '%') && (format[1] != '%')) {
+			field = conversionField(*++format);
+			
+			if (ended) {
+				fields[field] = !latest ? 0 : (field == Year) ? 9999 : 99;
+			} else if (*format == 'b') {
+				if (len - pos < 3) {
+					return -1;
+				}
+				
+				for (i = 0; i < 36; i += 3) {
+					if ((tolower((unsigned char) text[pos]) == monthNames[i]) &&
+						(tolower((unsigned char) text[pos + 1]) == monthNames[i + 1]) &&
+						(tolower((unsigned char) text[pos + 2]) == monthNames[i + 2])) {
+						break;
+					}
+				}
+				
+				if (i == 36) {
+					return -1;
+				}
+				
+				fields[Month] = i / 3 + 1;
+				pos += 3;
+				found++;
+			} else {
+				while ((pos < len) && (text[pos] == ' ')) {
+					pos++;
+				}
+				
+				for (digits = 0; (digits < ((field == Year) ? 4 : 2)) && (pos < len) &&
+						isdigit((unsigned char) text[pos]); digits++) {
+					fields[field] = fields[field] * 10 + (text[pos++] - '0');
+				}
+				
+				if (digits == 0) {
+					return -1;
+				}
+				
+				found++;
+			}
+		} else if (*format == ' ') {
+			while ((pos < len) && ((text[pos] == ' ') || (text[pos] == '\t'))) {
+				pos++;
+			}
+		} else {
+			if (*format == '%') {
+				format++;
+			}
+			
+			if (ended) {
+				continue;
+			}
+			
+			if ((pos == len) || (text[pos] != *format)) {
+				return -1;
+			}
+			
+			pos++;
+		}
+	}
+	
+	when->date = fields[Year] * 10000L + fields[Month] * 100L + fields[Day];
+	when->time = fields[Hour] * 10000L + fields[Minute] * 100L + fields[Second];
+	
+	return pos;
+}
+
+static int compareStamps(const stamp* a, const stamp* b) {
+	if (a->date != b->date) {
+		return (a->date < b->date) ? -1 : 1;
+	}
+	
+	if (a->time != b->time) {
+		return (a->time < b->time) ? -1 : 1;
+	}
+	
+	return 0;
+}
+
+/* Parses since or until, which must be a whole time. */
+static int parseEnd(time_window* window, const char* text, int latest, stamp* when) {
+	return (parseTime(window->format, text, (long) strlen(text), 1, latest, when) ==
+			(long) strlen(text)) ? 0 : -1;
+}
+
+/* Finds the first timestamped line that starts at or after offset, setting its offset
+   in lineStart and its time in when.  Returns 1, 0 if the file ends before there is
+   one, or -1 on an error. */
+static int probe(time_window* window, FILE* file, char lineEnd, long offset, long* lineStart,
+				 stamp* when) {
+	char text[MAX_STAMP];
+	long pos, len;
+	int c, end = (unsigned char) lineEnd;
+	
+	// unless the offset is at the start of a line, the line it falls in is skipped.
+	//
+	pos = (offset > 0) ? offset - 1 : 0;
+	
+	if (fseek(file, pos, SEEK_SET) != 0) {
+		return -1;
+	}
+	
+	if (offset > 0) {
+		do {
+			c = getc(file);
+			pos++;
+		} while ((c != EOF) && (c != end));
+		
+		if (c == EOF) {
+			return ferror(file) ? -1 : 0;
+		}
+	}
+	
+	for (;;) {
+		*lineStart = pos;
+		len = 0;
+		
+		while (((c = getc(file)) != EOF) && (c != end)) {
+			if (len < MAX_STAMP) {
+				text[len++] = (char) c;
+			}
+			
+			pos++;
+		}
+		
+		pos++;
+		
+		if (((len > 0) || (c != EOF)) && (parseTime(window->format, text, len, 0, 0, when) >= 0)) {
+			return 1;
+		}
+		
+		if (c == EOF) {
+			return ferror(file) ? -1 : 0;
+		}
+	}
+}
+
+/* Finds the offset of the first timestamped line from lo on whose time is at or after
+   bound (or, with after, past it), or size if there is none.  Returns 0 or -1. */
+static int bisect(time_window* window, FILE* file, char lineEnd, long lo, long size,
+				  const stamp* bound, int after, long* found) {
+	long hi = size, mid, lineStart;
+	stamp when;
+	int rc;
+	
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		
+		if ((rc = probe(window, file, lineEnd, mid, &lineStart, &when)) < 0) {
+			return -1;
+		}
+		
+		// every offset up to the line found stands for that same line.
+		//
+		if ((rc == 0) || (compareStamps(&when, bound) >= after)) {
+			hi = mid;
+		} else {
+			lo = lineStart + 1;
+		}
+	}
+	
+	if ((rc = probe(window, file, lineEnd, lo, &lineStart, &when)) < 0) {
+		return -1;
+	}
+	
+	*found = (rc > 0) ? lineStart : size;
+	return 0;
+}
+
+
+
+/* Public functions: */
+
+time_window* timewin_new(const char* format, const char* since, const char* until) {
+	time_window* window;
+	const char* f;
+	
+	for (f = format; *f != '\0'; f++) {
+		if ((*f == '%') && (*++f != '%') && (conversionField(*f) < 0)) {
+			return NULL;
+		}
+	}
+	
+	if ((window = (time_window*) calloc(1, sizeof(time_window))) == NULL) {
+		return NULL;
+	}
+	
+	if ((window->format = (char*) malloc(strlen(format) + 1)) == NULL) {
+		free(window);
+		return NULL;
+	}
+	
+	strcpy(window->format, format);
+	window->hasSince = (since != NULL);
+	window->hasUntil = (until != NULL);
+	
+	if ((window->hasSince && (parseEnd(window, since, 0, &window->since) < 0)) ||
+		(window->hasUntil && (parseEnd(window, until, 1, &window->until) < 0))) {
+		timewin_free(window);
+		return NULL;
+	}
+	
+	return window;
+}
+
+int timewin_range(time_window* window, FILE* file, char lineEnd, long* start, long* end) {
+	long size;
+	
+	if ((fseek(file, 0L, SEEK_END) != 0) || ((size = ftell(file)) < 0)) {
+		return -1;
+	}
+	
+	*start = 0;
+	*end = size;
+	
+	if (window->hasSince &&
+		(bisect(window, file, lineEnd, 0, size, &window->since, 0, start) < 0)) {
+		return -1;
+	}
+	
+	if (window->hasUntil &&
+		(bisect(window, file, lineEnd, *start, size, &window->until, 1, end) < 0)) {
+		return -1;
+	}
+	
+	return 0;
+}
+
+void timewin_free(time_window* window) {
+	if (window != NULL) {
+		free(window->format);
+		free(window);
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * Finding the part of a log that falls within a window of time, for gsgrep --since
+ * and --until.
+ *
+ * The lines of a log start with a timestamp, in a format given much as it is to
+ * strftime, and are in the order of their timestamps.  Rather than reading the log
+ * from its start, the first line in the window and the first line after it are found
+ * by a binary search of the file: seeking to the middle of a range, skipping to the
+ * start of the next line and reading its timestamp.  Lines without a timestamp (such
+ * as the rest of a long message) belong with the timestamped line before them.
+ */
+
+#ifndef _GSGREP_TIMEWIN_H
+#define _GSGREP_TIMEWIN_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+
+/* Typedef'd pointer to get abstract datatype. */
+typedef struct time_window time_window;
+
+
+/* The format used when none is given. */
+#define TIMEWIN_DEFAULT_FORMAT "%Y-%m-%d %H:%M:%S"
+
+
+/* Create a window from since to until, either of which may be NULL to leave that end
+   open.  Both are times in the given format, which may stop short: "2024-03-01" is the
+   start of that day for since, and the end of it for until.  The format is made up of
+   %Y (the year), %m (the month), %b (the abbreviated name of the month), %d or %e (the
+   day), %H, %M and %S (the time of day), %% and any other characters, which must
+   appear as they are; a space matches any amount of space.  Returns NULL if either
+   time doesn't match the format or there is not enough memory. */
+time_window* timewin_new(const char* format, const char* since, const char* until);
+
+
+/* Finds the part of file, whose lines end with lineEnd, that holds the lines within
+   the window: the offset of the first of them in start, and of the first line after
+   them in end.  Returns 0, or -1 if the file can't be read or seeked (as when it is a
+   pipe), with errno set. */
+int timewin_range(time_window* window, FILE* file, char lineEnd, long* start, long* end);
+
+
+/* Finish with a window made by timewin_new. */
+void timewin_free(time_window* window);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _GSGREP_TIMEWIN_H */